@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -8,10 +9,130 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <malloc.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/ioctl.h>
 
 // Global Variable: BGAllowed: int. 1 means background processes allowed. 0 means not allowed.
 int BGAllowed = 1;
 
+/************************************************************
+ * struct MemStats
+ * Description: the allocation counters of one subsystem
+ * Attributes: allocs: long, the number of live allocations
+ * 	       bytes: long, the number of live bytes
+ * 	       peakBytes: long, the highest value of bytes
+ * 	       totalAllocs: long, the number of allocations ever made
+ * *********************************************************/
+struct MemStats
+{
+	long allocs;
+	long bytes;
+	long peakBytes;
+	long totalAllocs;
+};
+
+// The subsystems whose memory is counted by memAlloc and memFree
+#define MEM_PARSER 0
+#define MEM_JOBS 1
+#define MEM_EXPAND 2
+#define MEM_INPUT 3
+#define MEM_EDITOR 4
+#define MEM_ENV 5
+#define MEM_SUBSYSTEMS 6
+
+const char *MEM_NAMES[MEM_SUBSYSTEMS] = {"parser", "jobs", "expansion", "input", "editor", "env"};
+
+// Global Variable: memStats: the allocation counters of each subsystem
+struct MemStats memStats[MEM_SUBSYSTEMS];
+
+/*************************************************************
+ * Function: memTrack
+ * Description: count a block allocated elsewhere, for example
+ * 		by getline, as a live allocation of subsystem
+ * Arguments: subsystem: int, one of the MEM_ values
+ * 	      ptr: a pointer to the block, may be NULL
+ * **********************************************************/
+void memTrack(int subsystem, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	struct MemStats *m = &memStats[subsystem];
+	m->allocs++;
+	m->totalAllocs++;
+	m->bytes += malloc_usable_size(ptr);
+	if (m->bytes > m->peakBytes)
+		m->peakBytes = m->bytes;
+}
+
+/*************************************************************
+ * Function: memAlloc
+ * Description: allocate size zeroed bytes and count them for
+ * 		subsystem
+ * Arguments: subsystem: int, one of the MEM_ values
+ * 	      size: size_t, the number of bytes
+ * Return value: a pointer to the memory, or NULL on failure
+ * **********************************************************/
+void* memAlloc(int subsystem, size_t size)
+{
+	void *ptr = calloc(1, size);
+	memTrack(subsystem, ptr);
+	return ptr;
+}
+
+/*************************************************************
+ * Function: memFree
+ * Description: free a block allocated by memAlloc or counted
+ * 		by memTrack for the same subsystem
+ * Arguments: subsystem: int, one of the MEM_ values
+ * 	      ptr: a pointer to the block, may be NULL
+ * **********************************************************/
+void memFree(int subsystem, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	memStats[subsystem].allocs--;
+	memStats[subsystem].bytes -= malloc_usable_size(ptr);
+	free(ptr);
+}
+
+// The kinds of struct Redirect
+#define REDIR_IN 0      // N< file
+#define REDIR_OUT 1     // N> file
+#define REDIR_APPEND 2  // N>> file
+#define REDIR_DUP 3     // N>&M or N<&M
+#define REDIR_CLOSE 4   // N>&-
+#define REDIR_HEREDOC 5 // N<<DELIM, until the body is read by readHereDocs
+#define REDIR_DATA 6    // N<<<word, or a here-document with its body read
+
+/************************************************************
+ * struct Redirect
+ * Description: one redirection of a command
+ * Attributes: type: int, one of the REDIR_ values
+ * 	       fd: int, the file descriptor of the child to set
+ * 	       srcFD: int, the file descriptor copied by REDIR_DUP
+ * 	       target: char*, the file of REDIR_IN, REDIR_OUT and
+ * 	       		REDIR_APPEND, the delimiter of REDIR_HEREDOC, the
+ * 	       		text of REDIR_DATA, NULL otherwise
+ * *********************************************************/
+struct Redirect
+{
+	int type;
+	int fd;
+	int srcFD;
+	char *target;
+};
+
 /************************************************************
  * struct CommandLine
  * Description: a dynamic array of char strings
@@ -19,6 +140,11 @@ int BGAllowed = 1;
  * 	       size: int, number of strings stored
  * 	       maxCommandLength: int, the length of the longest command
  * 	       bg: int, 1 means backgroun process, 0 means foreground
+ * 	       redirs: a dynamic array of struct Redirect, applied in
+ * 	       		order by execHandle
+ * 	       numRedirs: int, number of redirections stored
+ * 	       redirCapacity: int, number of redirections allocated
+ * 	       invalid: int, 1 if the line has a syntax error
  * 	       arr: a pointer to a dynamic array of strings
  * *********************************************************/
 struct CommandLine
@@ -26,8 +152,10 @@ struct CommandLine
 	int capacity;
 	int size;
 	int bg;
-	char* inputFile;
-	char* outputFile;
+	struct Redirect *redirs;
+	int numRedirs;
+	int redirCapacity;
+	int invalid;
 	char **arr;
 };
 
@@ -44,7 +172,7 @@ struct CommandLine
  * **********************************************************/
 void initCommandLine(struct CommandLine *r, int capacity)
 {
-	r->arr = (char**)malloc(capacity * sizeof(char*));
+	r->arr = (char**)memAlloc(MEM_PARSER, capacity * sizeof(char*));
 	assert(r->arr);
 	int i;
 	for (i=0; i<capacity; i++)
@@ -52,8 +180,10 @@ void initCommandLine(struct CommandLine *r, int capacity)
 	r->capacity = capacity;
 	r->size = 0;
 	r->bg = 0;
-	r->inputFile = NULL;
-	r->outputFile = NULL;
+	r->redirs = NULL;
+	r->numRedirs = 0;
+	r->redirCapacity = 0;
+	r->invalid = 0;
 }
 
 /**********************************************************************
@@ -71,22 +201,22 @@ void addCommandLine(struct CommandLine *r, char *str)
 {
 	if (r->size == r->capacity-1)
 	{
-		char  **temp = (char**)calloc(2 *r->capacity, sizeof(char*));
+		char  **temp = (char**)memAlloc(MEM_PARSER, 2 *r->capacity * sizeof(char*));
 		assert(temp);
 		int i;
 		for (i=0; i< r->size; i++)
 		{
-			temp[i] = (char*)calloc(strlen(r->arr[i])+1,sizeof(char));
+			temp[i] = (char*)memAlloc(MEM_PARSER, strlen(r->arr[i])+1);
 			assert(temp[i]);
 			strcpy(temp[i], r->arr[i]);
-			free(r->arr[i]);
+			memFree(MEM_PARSER, r->arr[i]);
 		}
-		free(r->arr);
+		memFree(MEM_PARSER, r->arr);
 		r->arr = temp;
 		r->capacity *= 2;
 	}
 	
-	r->arr[r->size] = (char*)calloc(strlen(str)+1, sizeof(char));
+	r->arr[r->size] = (char*)memAlloc(MEM_PARSER, strlen(str)+1);
 	assert(r->arr[r->size]);
 	strcpy(r->arr[r->size], str);
 	r->size++;
@@ -97,27 +227,442 @@ void addCommandLine(struct CommandLine *r, char *str)
  * Description: this function frees the memory dynamically allocated
  * 		for the attributes in CommandLine
  * Precondition: N/A
- * Postcondition: the memory for arr, inputFile, and outputFile is freed
+ * Postcondition: the memory for arr and the redirections is freed
  * *******************************************************************/
 void freeCommandLine(struct CommandLine *r)
 {
 	int i=0;
 	for (i=0; i< r->size; i++)
 	{
-		free(r->arr[i]);
+		memFree(MEM_PARSER, r->arr[i]);
 		r->arr[i] = NULL;
 	}
-	free(r->arr);
+	memFree(MEM_PARSER, r->arr);
 	r->arr = NULL;
-	free(r->inputFile);
-	r->inputFile = NULL;
-	free(r->outputFile);
-	r->outputFile = NULL;
+	for (i=0; i < r->numRedirs; i++)
+		memFree(MEM_PARSER, r->redirs[i].target);
+	memFree(MEM_PARSER, r->redirs);
+	r->redirs = NULL;
+	r->numRedirs = 0;
+	r->redirCapacity = 0;
 	r->size = 0;
 	r->capacity = 0;
 	r->bg = 0;
 }
 
+/*********************************************************************
+ * Function: shiftCommandLine
+ * Description: this function removes the first n words of the
+ * 		CommandLine. It is used by prefix commands such as memo
+ * 		to strip themselves before running the real command.
+ * Arguments: r: a pointer to CommandLine
+ * 	      n: int, the number of words to remove
+ * Precondition: 0 <= n <= r->size
+ * Postcondition: the first n strings are freed, the remaining ones
+ * 		  are moved to the front, and size is decremented by n.
+ * *******************************************************************/
+void shiftCommandLine(struct CommandLine *r, int n)
+{
+	int i;
+	assert(n >= 0 && n <= r->size);
+	for (i=0; i < n; i++)
+		memFree(MEM_PARSER, r->arr[i]);
+	for (i=n; i < r->size; i++)
+		r->arr[i-n] = r->arr[i];
+	for (i=r->size-n; i < r->size; i++)
+		r->arr[i] = NULL;
+	r->size -= n;
+}
+
+/*********************************************************************
+ * Function: addRedirect
+ * Description: add a redirection to the end of the CommandLine
+ * Arguments: r: a pointer to CommandLine
+ * 	      type: int, one of the REDIR_ values
+ * 	      fd: int, the file descriptor of the child to set
+ * 	      srcFD: int, the file descriptor copied by REDIR_DUP
+ * 	      target: char*, the file name, or NULL
+ * Postcondition: a copy of target is stored with the redirection
+ * *******************************************************************/
+void addRedirect(struct CommandLine *r, int type, int fd, int srcFD, const char *target)
+{
+	if (r->numRedirs == r->redirCapacity)
+	{
+		int capacity = r->redirCapacity ? 2 * r->redirCapacity : 4;
+		struct Redirect *temp = (struct Redirect*)memAlloc(MEM_PARSER, capacity * sizeof(struct Redirect));
+		assert(temp);
+		if (r->numRedirs)
+			memcpy(temp, r->redirs, r->numRedirs * sizeof(struct Redirect));
+		memFree(MEM_PARSER, r->redirs);
+		r->redirs = temp;
+		r->redirCapacity = capacity;
+	}
+	struct Redirect *redir = &r->redirs[r->numRedirs++];
+	redir->type = type;
+	redir->fd = fd;
+	redir->srcFD = srcFD;
+	redir->target = NULL;
+	if (target)
+	{
+		redir->target = (char*)memAlloc(MEM_PARSER, strlen(target)+1);
+		assert(redir->target);
+		strcpy(redir->target, target);
+	}
+}
+
+/*********************************************************************
+ * Function: findRedirect
+ * Description: find the last redirection of a file descriptor, which
+ * 		is the one that is in effect when the command runs
+ * Arguments: r: a pointer to CommandLine
+ * 	      fd: int, the file descriptor of the child
+ * Return value: a pointer to the struct Redirect, or NULL if fd is
+ * 		 not redirected
+ * *******************************************************************/
+struct Redirect* findRedirect(struct CommandLine *r, int fd)
+{
+	int i;
+	for (i=r->numRedirs-1; i >= 0; i--)
+		if (r->redirs[i].fd == fd)
+			return &r->redirs[i];
+	return NULL;
+}
+
+/*********************************************************************
+ * Function: removeRedirects
+ * Description: remove every redirection of a file descriptor
+ * Arguments: r: a pointer to CommandLine
+ * 	      fd: int, the file descriptor of the child
+ * *******************************************************************/
+void removeRedirects(struct CommandLine *r, int fd)
+{
+	int i, j;
+	for (i=0, j=0; i < r->numRedirs; i++)
+	{
+		if (r->redirs[i].fd == fd)
+			memFree(MEM_PARSER, r->redirs[i].target);
+		else
+			r->redirs[j++] = r->redirs[i];
+	}
+	r->numRedirs = j;
+}
+
+
+/**********************************************************************
+ * struct EnvEntry
+ * Description: one environment variable in the hash table of the
+ * 		environment store
+ * Attributes: pair: char*, "NAME=value", ready to be put in envp
+ * 	       nameLen: int, the length of NAME
+ * 	       next: a pointer to the next entry in the same bucket
+ * *******************************************************************/
+struct EnvEntry
+{
+	char *pair;
+	int nameLen;
+	struct EnvEntry *next;
+};
+
+/**********************************************************************
+ * struct EnvStore
+ * Description: the environment of the shell and of the commands it
+ * 		runs. The variables are kept in a hash table. envp is
+ * 		the array passed to exec; it is only rebuilt when
+ * 		generation has changed since it was last built.
+ * Attributes: buckets: an array of chains of struct EnvEntry
+ * 	       numBuckets: int, the number of buckets
+ * 	       size: int, the number of variables
+ * 	       generation: unsigned long, incremented on every change
+ * 	       envp: a NULL terminated array of the pairs
+ * 	       envpCapacity: int, the number of char* allocated for envp
+ * 	       envpGeneration: unsigned long, the generation envp was
+ * 	       		built at
+ * *******************************************************************/
+struct EnvStore
+{
+	struct EnvEntry **buckets;
+	int numBuckets;
+	int size;
+	unsigned long generation;
+	char **envp;
+	int envpCapacity;
+	unsigned long envpGeneration;
+};
+
+// Global Variable: envStore: the environment of the shell
+struct EnvStore envStore = {NULL, 0, 0, 1, NULL, 0, 0};
+
+/**********************************************************************
+ * Function: envHash
+ * Description: FNV-1a hash of a variable name
+ * Arguments: name: char*, the name, not necessarily null terminated
+ * 	      len: int, the length of the name
+ * Return value: the hash
+ * *******************************************************************/
+unsigned long envHash(const char *name, int len)
+{
+	unsigned long h = 2166136261UL;
+	int i;
+	for (i=0; i < len; i++)
+	{
+		h ^= (unsigned char)name[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+/**********************************************************************
+ * Function: envFind
+ * Description: find the link that points to the entry of a variable
+ * Arguments: name: char*, the name, not necessarily null terminated
+ * 	      len: int, the length of the name
+ * Return value: a pointer to the link to the entry. *link is NULL if
+ * 		 the variable is not set; a new entry can be put there.
+ * *******************************************************************/
+struct EnvEntry** envFind(const char *name, int len)
+{
+	struct EnvEntry **link = &envStore.buckets[envHash(name, len) % envStore.numBuckets];
+	while (*link && ((*link)->nameLen != len || strncmp((*link)->pair, name, len) != 0))
+		link = &(*link)->next;
+	return link;
+}
+
+/**********************************************************************
+ * Function: envGet
+ * Description: look up a variable in the environment store. This is
+ * 		used instead of getenv in the whole shell.
+ * Argument: name: char*, the name of the variable
+ * Return value: the value, or NULL if the variable is not set
+ * *******************************************************************/
+char* envGet(const char *name)
+{
+	if (envStore.numBuckets == 0)
+		return getenv(name);
+	int len = strlen(name);
+	struct EnvEntry *e = *envFind(name, len);
+	return e ? e->pair + len + 1 : NULL;
+}
+
+/**********************************************************************
+ * Function: envSet
+ * Description: set a variable in the environment store
+ * Arguments: name: char*, the name, not necessarily null terminated
+ * 	      len: int, the length of the name
+ * 	      value: char*, the value
+ * Postcondition: the variable is set and the generation is incremented.
+ * 		  The table doubles when it gets twice as full as it has
+ * 		  buckets.
+ * *******************************************************************/
+void envSet(const char *name, int len, const char *value)
+{
+	int i;
+	if (envStore.size >= 2 * envStore.numBuckets)
+	{
+		int numBuckets = envStore.numBuckets ? 2 * envStore.numBuckets : 64;
+		struct EnvEntry **buckets = (struct EnvEntry**)memAlloc(MEM_ENV, numBuckets * sizeof(struct EnvEntry*));
+		assert(buckets);
+		for (i=0; i < envStore.numBuckets; i++)
+		{
+			struct EnvEntry *e = envStore.buckets[i], *next;
+			for ( ; e; e = next)
+			{
+				next = e->next;
+				unsigned long h = envHash(e->pair, e->nameLen) % numBuckets;
+				e->next = buckets[h];
+				buckets[h] = e;
+			}
+		}
+		memFree(MEM_ENV, envStore.buckets);
+		envStore.buckets = buckets;
+		envStore.numBuckets = numBuckets;
+	}
+	struct EnvEntry **link = envFind(name, len);
+	if (*link == NULL)
+	{
+		*link = (struct EnvEntry*)memAlloc(MEM_ENV, sizeof(struct EnvEntry));
+		assert(*link);
+		(*link)->nameLen = len;
+		envStore.size++;
+	}
+	else
+		memFree(MEM_ENV, (*link)->pair);
+	char *pair = (char*)memAlloc(MEM_ENV, len + strlen(value) + 2);
+	assert(pair);
+	memcpy(pair, name, len);
+	pair[len] = '=';
+	strcpy(pair + len + 1, value);
+	(*link)->pair = pair;
+	envStore.generation++;
+}
+
+/**********************************************************************
+ * Function: envUnset
+ * Description: remove a variable from the environment store
+ * Argument: name: char*, the name of the variable
+ * Postcondition: if the variable was set, it is removed and the
+ * 		  generation is incremented.
+ * *******************************************************************/
+void envUnset(const char *name)
+{
+	struct EnvEntry **link = envFind(name, strlen(name));
+	if (*link == NULL)
+		return;
+	struct EnvEntry *junk = *link;
+	*link = junk->next;
+	memFree(MEM_ENV, junk->pair);
+	memFree(MEM_ENV, junk);
+	envStore.size--;
+	envStore.generation++;
+}
+
+/**********************************************************************
+ * Function: envInit
+ * Description: fill the environment store from the environment the
+ * 		shell was started with
+ * Precondition: the store is empty
+ * *******************************************************************/
+void envInit()
+{
+	char **p;
+	envSet("", 0, "");  //allocates the table
+	envUnset("");
+	for (p = environ; *p; p++)
+	{
+		char *eq = strchr(*p, '=');
+		if (eq)
+			envSet(*p, eq - *p, eq + 1);
+	}
+}
+
+/**********************************************************************
+ * Function: envEnvp
+ * Description: get the envp array of the environment store. It is
+ * 		rebuilt only if a variable changed since the last call,
+ * 		so starting a command normally costs nothing here. It is
+ * 		called in the parent before fork, so the array is built
+ * 		once and kept instead of in each child's copy.
+ * Return value: a NULL terminated array of "NAME=value" strings
+ * *******************************************************************/
+char** envEnvp()
+{
+	int i, n = 0;
+	if (envStore.envp && envStore.envpGeneration == envStore.generation)
+		return envStore.envp;
+	if (envStore.size + 1 > envStore.envpCapacity)
+	{
+		memFree(MEM_ENV, envStore.envp);
+		envStore.envpCapacity = 2 * (envStore.size + 1);
+		envStore.envp = (char**)memAlloc(MEM_ENV, envStore.envpCapacity * sizeof(char*));
+		assert(envStore.envp);
+	}
+	for (i=0; i < envStore.numBuckets; i++)
+	{
+		struct EnvEntry *e;
+		for (e = envStore.buckets[i]; e; e = e->next)
+			envStore.envp[n++] = e->pair;
+	}
+	envStore.envp[n] = NULL;
+	envStore.envpGeneration = envStore.generation;
+	return envStore.envp;
+}
+
+/**********************************************************************
+ * Function: assignmentLength
+ * Description: check whether a word is an assignment NAME=value
+ * Argument: word: char*
+ * Return value: the length of NAME, or 0 if word is not an assignment
+ * *******************************************************************/
+int assignmentLength(const char *word)
+{
+	int i = 0;
+	if (!(word[0] == '_' || (word[0] >= 'A' && word[0] <= 'Z') || (word[0] >= 'a' && word[0] <= 'z')))
+		return 0;
+	while (word[i] == '_' || (word[i] >= 'A' && word[i] <= 'Z') || (word[i] >= 'a' && word[i] <= 'z')
+		|| (word[i] >= '0' && word[i] <= '9'))
+		i++;
+	return word[i] == '=' ? i : 0;
+}
+
+/**********************************************************************
+ * struct EnvUndo
+ * Description: the old values of the variables set by the NAME=value
+ * 		words in front of a command, so they can be put back
+ * 		after the command has started
+ * Attributes: old: the old "NAME=value" of each variable, or just
+ * 	       		"NAME" if it was not set
+ * 	       size: int, the number of assignments
+ * *******************************************************************/
+struct EnvUndo
+{
+	char **old;
+	int size;
+};
+
+/**********************************************************************
+ * Function: applyAssignments
+ * Description: set the variables of the NAME=value words at the start
+ * 		of the CommandLine and remove the words. If a command
+ * 		follows, the old values are recorded in undo so that
+ * 		restoreAssignments can put them back.
+ * Arguments: c: a pointer to CommandLine
+ * 	      undo: a pointer to a struct EnvUndo
+ * Postcondition: the variables are set and c starts with the command
+ * *******************************************************************/
+void applyAssignments(struct CommandLine *c, struct EnvUndo *undo)
+{
+	int n = 0, i;
+	undo->old = NULL;
+	undo->size = 0;
+	while (n < c->size && assignmentLength(c->arr[n]) > 0)
+		n++;
+	if (n == 0)
+		return;
+	if (n < c->size)
+	{
+		undo->old = (char**)memAlloc(MEM_ENV, n * sizeof(char*));
+		assert(undo->old);
+		undo->size = n;
+	}
+	for (i=0; i < n; i++)
+	{
+		int len = assignmentLength(c->arr[i]);
+		if (undo->old)
+		{
+			struct EnvEntry *e = *envFind(c->arr[i], len);
+			undo->old[i] = (char*)memAlloc(MEM_ENV, (e ? strlen(e->pair) : len) + 1);
+			assert(undo->old[i]);
+			if (e)
+				strcpy(undo->old[i], e->pair);
+			else
+				memcpy(undo->old[i], c->arr[i], len);  //no '=' means it was unset
+		}
+		envSet(c->arr[i], len, c->arr[i] + len + 1);
+	}
+	shiftCommandLine(c, n);
+}
+
+/**********************************************************************
+ * Function: restoreAssignments
+ * Description: put back the variables recorded by applyAssignments
+ * Argument: undo: a pointer to a struct EnvUndo
+ * Postcondition: the variables have their old values and undo is freed
+ * *******************************************************************/
+void restoreAssignments(struct EnvUndo *undo)
+{
+	int i;
+	for (i=undo->size-1; i >= 0; i--)
+	{
+		char *eq = strchr(undo->old[i], '=');
+		if (eq)
+			envSet(undo->old[i], eq - undo->old[i], eq + 1);
+		else
+			envUnset(undo->old[i]);
+		memFree(MEM_ENV, undo->old[i]);
+	}
+	memFree(MEM_ENV, undo->old);
+	undo->old = NULL;
+	undo->size = 0;
+}
 
 /**********************************************************************
  * struct Link
@@ -127,6 +672,13 @@ void freeCommandLine(struct CommandLine *r)
  * 	       		information for the process
  * 	       builtIn: int. 1 means the process is a built-in bash
  * 	       		function, 0 otherwise.
+ * 	       timerFD: int, a timerfd that fires at the deadline of the
+ * 	       		process, or -1 if it has no deadline
+ * 	       timedOut: int, 0 if the deadline has not passed, 1 after
+ * 	       		SIGTERM was sent, 2 after SIGKILL was sent
+ * 	       procFD: the open /proc stat, statm and io files of the
+ * 	       		process, -1 until jobs -m samples it
+ * 	       cpuTicks: the utime + stime of the process at the last sample
  * 	       next: a pointer to a struct Link
  * *******************************************************************/
 struct Link
@@ -134,6 +686,10 @@ struct Link
 	pid_t pidNo;
 	struct CommandLine* command;
 	int builtIn;
+	int timerFD;
+	int timedOut;
+	int procFD[3];
+	unsigned long long cpuTicks;
 	struct Link* next;
 };
 
@@ -146,13 +702,17 @@ struct Link
  * 	     b: int, indicating whether the process is a built-in function
  * Precondition: l has been declared
  * Postcondition: pidNo is set to l, command is set to c, builtIn is set 
- * 		  to b, and next is set to NULL.
+ * 		  to b, the process has no deadline, and next is set to NULL.
  * ***********************************************************************/
 void initLink(struct Link* l, pid_t p, struct CommandLine* c, int b)
 {
 	l->pidNo = p;
 	l->command = c;
 	l->builtIn = b;
+	l->timerFD = -1;
+	l->timedOut = 0;
+	l->procFD[0] = l->procFD[1] = l->procFD[2] = -1;
+	l->cpuTicks = 0;
 	l->next = NULL;
 }
 
@@ -160,7 +720,9 @@ void initLink(struct Link* l, pid_t p, struct CommandLine* c, int b)
  * Function: freeLink
  * Description: The attribute command is dynamically allocated elsewhere
  * 		in the shell function. This function frees the memory of
- * 		command. It also frees the memory for struct Link.
+ * 		command, unless it is NULL because a built-in function
+ * 		keeps it. It also closes the timerfd and /proc files and
+ * 		frees the memory for struct Link.
  * Argument: l: a pointer to a struct Link
  * Precondition: N/A
  * Postcondition: The memory dynamically allocated to the attributes of
@@ -168,9 +730,18 @@ void initLink(struct Link* l, pid_t p, struct CommandLine* c, int b)
  * ***********************************************************************/
 void freeLink(struct Link *l)
 {
-	freeCommandLine(l->command);
-	free(l->command);
-	free(l);
+	if (l->command)
+	{
+		freeCommandLine(l->command);
+		memFree(MEM_PARSER, l->command);
+	}
+	int i;
+	if (l->timerFD != -1)
+		close(l->timerFD);
+	for (i=0; i < 3; i++)
+		if (l->procFD[i] != -1)
+			close(l->procFD[i]);
+	memFree(MEM_JOBS, l);
 }
 
 /*********************************************************************
@@ -211,10 +782,11 @@ void initChildrenPids(struct ChildrenPids* children)
  * Postcondition: a struct Link is constructed from pidNo, command, and 
  * 		  builtIn. And it is added to the linked list maintained by 
  * 		  struct ChildrenPids
+ * Return value: a pointer to the new struct Link
  * *******************************************************************/
-void addChildrenPids(struct ChildrenPids* children, pid_t pidNo, struct CommandLine* command, int builtIn)
+struct Link* addChildrenPids(struct ChildrenPids* children, pid_t pidNo, struct CommandLine* command, int builtIn)
 {
-	struct Link *l = (struct Link*)malloc(sizeof(struct Link));
+	struct Link *l = (struct Link*)memAlloc(MEM_JOBS, sizeof(struct Link));
 	assert(l);
 	initLink(l, pidNo, command, builtIn);
 	if (children->size == 0)
@@ -228,6 +800,7 @@ void addChildrenPids(struct ChildrenPids* children, pid_t pidNo, struct CommandL
 		temp->next = l;
 	}
 	children->size++;
+	return l;
 }
 
 /**********************************************************************
@@ -256,6 +829,22 @@ int inChildrenPids(struct ChildrenPids* children, pid_t num)
 	return 0;
 }
 
+/**********************************************************************
+ * Function: findChildrenPids
+ * Description: the function searches the linked list in struct childrenPids
+ * 		for the given pid and returns the struct Link that stores it.
+ * Arguments: children: a pointer to the struct childrenPids
+ * 	      num: pid_t, the pid that is searched for in children
+ * Return values: a pointer to the struct Link, or NULL if num is not in children
+ **********************************************************************/
+struct Link* findChildrenPids(struct ChildrenPids* children, pid_t num)
+{
+	struct Link *temp = children->list;
+	while (temp && temp->pidNo != num)
+		temp = temp->next;
+	return temp;
+}
+
 /*********************************************************************
  * Function: deleteChildrenPids
  * Description: if the pid is in the argument struct childrenPids, then 
@@ -320,440 +909,4165 @@ void freeChildrenPids(struct ChildrenPids* children)
 	children->size = 0;
 }
 
+// Global Variable: bgDeadline: long, the default deadline in ms of background
+// processes. 0 means background processes have no deadline.
+long bgDeadline = 0;
 
+// The time a timed out process gets between SIGTERM and SIGKILL
+#define TIMEOUT_KILL_GRACE 2000
 
 /*****************************************************************************
- * Function: readline
- * Description: read a line of user input. It will read a line despite signal
- * 		interruptions
- * Argument: line: char*
- * Precondition: char* is NULL or not initialized.
- * Postcondition: char* is allocated and filled with user input
- * Return value: the size of the input
+ * Function: parseDuration
+ * Description: convert a duration such as "30", "1.5s", "250ms", "2m" or "1h"
+ * 		to milliseconds. A number without a suffix is in seconds.
+ * Argument: str: char*, the duration
+ * Return value: the duration in ms, or -1 if str is not a duration
  * ***************************************************************************/
-int readLine(char **line)
+long parseDuration(const char *str)
 {
-	*line = NULL;
-	int numCharsEntered = -5;
-	size_t bufferSize = 0;
-	while (1)
-	{
-		numCharsEntered = getline(line, &bufferSize, stdin);
-		if (numCharsEntered == -1)
-			clearerr(stdin);
-		else
-			break;  //exit loop. The input is valid.
-	}
-
-	return numCharsEntered;
+	char *end;
+	double value = strtod(str, &end);
+	if (end == str || value < 0)
+		return -1;
+	if (strcmp(end, "") == 0 || strcmp(end, "s") == 0)
+		value *= 1000;
+	else if (strcmp(end, "m") == 0)
+		value *= 60 * 1000;
+	else if (strcmp(end, "h") == 0)
+		value *= 60 * 60 * 1000;
+	else if (strcmp(end, "ms") != 0)
+		return -1;
+	return (long)value;
 }
 
-/***********************************************************************************
- * Function: expandShellPid
- * Description: this function replaces "$$" in the string to the pid of the current
- * 		process.
- * Argument: str, char*
- * Precondition: str has "$$"
- * Postcondition: "$$" is replaced with pid
- * Return value: a char* pointed to a string that has pid
- * ********************************************************************************/
-char* expandShellPid(char* str)
+/*****************************************************************************
+ * Function: armTimer
+ * Description: (re)arm the timerfd of a process so that it fires once after ms
+ * 		milliseconds. The timerfd is created if the process has none.
+ * Arguments: l: a pointer to the struct Link of the process
+ * 	      ms: long, the time until the timer fires
+ * Postcondition: l->timerFD is a non-blocking timerfd, or -1 on failure
+ * ***************************************************************************/
+void armTimer(struct Link *l, long ms)
 {
-	char* pos = strstr(str, "$$");
-	char* newStr = (char*)calloc(strlen(str)+10, sizeof(char)); //return string
-	char pidStr[8]; //char string of pid
-	memset(pidStr, '\0', 8);
-	sprintf(pidStr, "%d", getpid());
-	char* i;
-	int j, k;
-	for (i = str, j=0; i < pos; i++, j++) //copy over every char of str before $$
-		newStr[j] = *i;
-	for (k=0; k<strlen(pidStr); k++, j++) //copy over pid
-		newStr[j] = pidStr[k];
-	i += 2;  //copy over every char of str after $$
-	for ( ;i < str+strlen(str); i++, j++)
-		newStr[j] = *i;
-	return newStr;
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = ms / 1000;
+	spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+	if (ms == 0)
+		spec.it_value.tv_nsec = 1;
+	if (l->timerFD == -1)
+		l->timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (l->timerFD == -1)
+	{
+		perror("timerfd_create");
+		return;
+	}
+	timerfd_settime(l->timerFD, 0, &spec, NULL);
 }
 
-
-/*******************************************************************************
- * Function: parseLine
- * Description: parse the input line into words and store the words in struct
- * 		CommandLine
- * Argument: line: a char* to be parsed
- * Precondition: line is composed of words separated by spaces. It doesn't have an
- * 		ending '\n'.
- * Postcondition: line is altered by strtok
- * Return value: a pointer to a dynamically allocated strct CommandLine that stores
- * 		 the words of the line, the input and output, and whether or not
- * 		 background process
- * *****************************************************************************/
-struct CommandLine*  parseLine(char* line)
-{	
-	char* token = NULL; // set null pointer
-	char* rest = line;
-
-	struct CommandLine* commands = (struct CommandLine*)malloc(sizeof(struct CommandLine));
-	assert(commands);
-	initCommandLine(commands,10);
-	while ((token = strtok_r(rest, " ", &rest)))
-	{	
-		if (strcmp(token, "<") == 0)  //set the inputFile
-		{
-			token = strtok_r(rest, " ", &rest);
-			commands->inputFile = (char*)calloc(strlen(token)+1, sizeof(char));
-			assert(commands->inputFile);
-			strcpy(commands->inputFile, token);
+/*****************************************************************************
+ * Function: checkTimers
+ * Description: read the timerfd of every process in children. When the
+ * 		deadline of a process has passed it is sent SIGTERM, and if it is
+ * 		still running TIMEOUT_KILL_GRACE ms later it is sent SIGKILL.
+ * Argument: children: a pointer to a struct ChildrenPids
+ * Precondition: N/A
+ * Postcondition: the expired processes are signaled and marked timed out.
+ * ***************************************************************************/
+void checkTimers(struct ChildrenPids *children)
+{
+	uint64_t expirations;
+	struct Link *temp;
+	for (temp = children->list; temp; temp = temp->next)
+	{
+		if (temp->timerFD == -1 || read(temp->timerFD, &expirations, sizeof(expirations)) <= 0)
 			continue;
-		}	
-		if (strcmp(token, ">") == 0)  //set the outputFile
+		if (temp->timedOut == 0)
 		{
-			token = strtok_r(rest, " ", &rest);
-			commands->outputFile = (char*)calloc(strlen(token)+1, sizeof(char));
-			assert(commands->outputFile);
-			strcpy(commands->outputFile, token);
-			continue;
+			kill(temp->pidNo, SIGTERM);
+			temp->timedOut = 1;
+			armTimer(temp, TIMEOUT_KILL_GRACE);
 		}
-		if (strstr(token, "$$") != 0)  //expand "$$" and add the command to the struct
+		else
 		{
-			char *expanded = expandShellPid(token);
-			while (strstr(expanded, "$$") != 0)
-			{
-				char *temp = expandShellPid(expanded);
-				free(expanded);
-				expanded = temp;
-			}
-			addCommandLine(commands, expanded);
-			free(expanded);
-			continue;
+			kill(temp->pidNo, SIGKILL);
+			temp->timedOut = 2;
 		}
-		addCommandLine(commands,token);
 	}
-	
-	// Set up for the background process
-	if (commands->size > 0)
+}
+
+/*****************************************************************************
+ * Function: pollTimers
+ * Description: wait until fd is readable. Meanwhile the timerfds of the
+ * 		processes in children are handled as they fire.
+ * Arguments: children: a pointer to a struct ChildrenPids
+ * 	      fd: int, the file descriptor to wait for, or -1 for none
+ * 	      mask: the signal mask while waiting, like sigsuspend, or NULL to
+ * 	      	    keep the current one. A signal it lets through ends the wait.
+ * 	      timeout: the longest wait in milliseconds, or -1 for no limit
+ * Postcondition: fd is readable, a signal was caught, the timeout passed or
+ * 		  poll failed
+ * Return value: 1 if fd is readable, otherwise 0
+ * ***************************************************************************/
+int pollTimers(struct ChildrenPids *children, int fd, const sigset_t *mask, long timeout)
+{
+	struct pollfd *fds = (struct pollfd*)memAlloc(MEM_JOBS, (children->size + 1) * sizeof(struct pollfd));
+	assert(fds);
+	struct timespec end, now, left;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout / 1000;
+	end.tv_nsec += (timeout % 1000) * 1000000;
+	if (end.tv_nsec >= 1000000000)
+	{
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000;
+	}
+	int ready = 0;
+	while (1)
+	{
+		struct Link *temp;
+		int n = 1, r;
+		if (timeout >= 0)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left.tv_sec = end.tv_sec - now.tv_sec;
+			left.tv_nsec = end.tv_nsec - now.tv_nsec;
+			if (left.tv_nsec < 0)
+			{
+				left.tv_sec--;
+				left.tv_nsec += 1000000000;
+			}
+			if (left.tv_sec < 0)
+				break;
+		}
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		for (temp = children->list; temp; temp = temp->next)
+		{
+			if (temp->timerFD == -1)
+				continue;
+			fds[n].fd = temp->timerFD;
+			fds[n].events = POLLIN;
+			n++;
+		}
+		r = ppoll(fds, n, timeout >= 0 ? &left : NULL, mask);
+		if (r == -1)
+		{
+			if (errno == EINTR && mask == NULL)
+				continue;
+			break;
+		}
+		if (r == 0)
+			break;
+		if (fds[0].revents)
+		{
+			ready = 1;
+			break;
+		}
+		checkTimers(children);
+	}
+	memFree(MEM_JOBS, fds);
+	return ready;
+}
+
+/*****************************************************************************
+ * Function: waitChild
+ * Description: wait for the child process pid like waitpid does. While waiting,
+ * 		the deadlines of pid and of the background processes are enforced.
+ * 		The child is watched through a pidfd so that the wait and the
+ * 		timerfds can be polled together.
+ * Arguments: children: a pointer to a struct ChildrenPids
+ * 	      pid: pid_t, the child process to wait for
+ * 	      childExitMethod: int*, the exit method of the child is stored here
+ * Return value: the return value of waitpid
+ * ***************************************************************************/
+pid_t waitChild(struct ChildrenPids *children, pid_t pid, int *childExitMethod)
+{
+	int pidFD = syscall(SYS_pidfd_open, pid, 0);
+	if (pidFD != -1)
+	{
+		pollTimers(children, pidFD, NULL, -1);
+		close(pidFD);
+	}
+	return waitpid(pid, childExitMethod, 0);
+}
+
+
+
+/*****************************************************************************
+ * struct History
+ * Description: the command history. The history file is mmap'd at startup
+ * 		and its lines are used in place; the lines typed in this session
+ * 		are copied to the heap and appended to the file.
+ * Attributes: map: the mmap'd history file, or NULL
+ * 	       mapSize: size_t, the size of the mapping
+ * 	       lines: an array of pointers to the lines, oldest first
+ * 	       lens: int*, the length of each line
+ * 	       size: int, the number of lines
+ * 	       capacity: int, the number of lines allocated
+ * 	       fd: int, the history file opened for appending, or -1
+ * ***************************************************************************/
+struct History
+{
+	char *map;
+	size_t mapSize;
+	const char **lines;
+	int *lens;
+	int size;
+	int capacity;
+	int fd;
+};
+
+// Global Variable: history: the history of the line editor, loaded on first use
+struct History history = {NULL, 0, NULL, NULL, 0, 0, -2};
+
+// The most lines kept in memory. Older ones stay in the file.
+#define HISTORY_MAX 10000
+
+/*****************************************************************************
+ * Function: addHistory
+ * Description: add a line to the history. If the line is not in the mmap'd
+ * 		file it is copied to the heap. The oldest line is dropped once
+ * 		there are HISTORY_MAX lines.
+ * Arguments: line: char*, the line, not necessarily null terminated
+ * 	      len: int, the length of the line
+ * ***************************************************************************/
+void addHistory(const char *line, int len)
+{
+	int inMap = history.map && line >= history.map && line < history.map + history.mapSize;
+	if (history.size == HISTORY_MAX)
+	{
+		const char *oldest = history.lines[0];
+		if (!(history.map && oldest >= history.map && oldest < history.map + history.mapSize))
+			memFree(MEM_EDITOR, (void*)oldest);
+		memmove(history.lines, history.lines + 1, (history.size - 1) * sizeof(char*));
+		memmove(history.lens, history.lens + 1, (history.size - 1) * sizeof(int));
+		history.size--;
+	}
+	if (history.size == history.capacity)
+	{
+		int capacity = history.capacity ? 2 * history.capacity : 256;
+		const char **lines = (const char**)memAlloc(MEM_EDITOR, capacity * sizeof(char*));
+		int *lens = (int*)memAlloc(MEM_EDITOR, capacity * sizeof(int));
+		assert(lines && lens);
+		if (history.size)
+		{
+			memcpy(lines, history.lines, history.size * sizeof(char*));
+			memcpy(lens, history.lens, history.size * sizeof(int));
+		}
+		memFree(MEM_EDITOR, history.lines);
+		memFree(MEM_EDITOR, history.lens);
+		history.lines = lines;
+		history.lens = lens;
+		history.capacity = capacity;
+	}
+	if (!inMap)
+	{
+		char *copy = (char*)memAlloc(MEM_EDITOR, len + 1);
+		assert(copy);
+		memcpy(copy, line, len);
+		line = copy;
+	}
+	history.lines[history.size] = line;
+	history.lens[history.size] = len;
+	history.size++;
+}
+
+/*****************************************************************************
+ * Function: openHistory
+ * Description: mmap the history file, which is SMALLSH_HISTORY if set and
+ * 		$HOME/.smallsh_history otherwise, index its lines, and keep it
+ * 		open for appending. Only the newest HISTORY_MAX lines are
+ * 		indexed; they are found by scanning back from the end, so a long
+ * 		file costs no more than a short one. The file itself is never
+ * 		rewritten, since other shells may be appending to it.
+ * Precondition: history has not been opened
+ * Postcondition: history holds the lines of the file. history.fd is -1 if
+ * 		  the file can't be opened.
+ * ***************************************************************************/
+void openHistory()
+{
+	char path[1024];
+	char *env = envGet("SMALLSH_HISTORY");
+	if (env && env[0] != '\0')
+		snprintf(path, sizeof(path), "%s", env);
+	else
+		snprintf(path, sizeof(path), "%s/.smallsh_history", envGet("HOME") ? envGet("HOME") : ".");
+	history.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	struct stat st;
+	if (history.fd == -1 || fstat(history.fd, &st) == -1 || st.st_size == 0)
+		return;
+	history.map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history.fd, 0);
+	if (history.map == MAP_FAILED)
+	{
+		history.map = NULL;
+		return;
+	}
+	history.mapSize = st.st_size;
+	const char *end = history.map + history.mapSize, *p = end;
+	const char *lineEnd = end;
+	int n = 0;
+	if (lineEnd > history.map && lineEnd[-1] == '\n')
+		lineEnd--;
+	while (1)
+	{
+		const char *nl = (const char*)memrchr(history.map, '\n', lineEnd - history.map);
+		p = nl ? nl + 1 : history.map;
+		if (lineEnd > p)
+			n++;
+		if (nl == NULL || n == HISTORY_MAX)
+			break;
+		lineEnd = nl;
+	}
+	while (p < end)
+	{
+		const char *nl = (const char*)memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		if (nl > p)
+			addHistory(p, nl - p);
+		p = nl + 1;
+	}
+}
+
+/*****************************************************************************
+ * Function: saveHistory
+ * Description: add a line typed by the user to the history and append it to
+ * 		the history file. Blank lines and repeats of the last line are
+ * 		not saved.
+ * Arguments: line: char*, the line without the newline
+ * 	      len: int, the length of the line
+ * ***************************************************************************/
+void saveHistory(const char *line, int len)
+{
+	if (len == 0 || (history.size && history.lens[history.size-1] == len
+		&& memcmp(history.lines[history.size-1], line, len) == 0))
+		return;
+	addHistory(line, len);
+	if (history.fd >= 0)
+	{
+		struct iovec iov[2] = {{(void*)line, len}, {"\n", 1}};
+		writev(history.fd, iov, 2);
+	}
+}
+
+/*****************************************************************************
+ * struct TrieNode
+ * Description: a node of the trie of executable names on PATH
+ * Attributes: c: char, the char of this node
+ * 	       count: int, the number of PATH directories that have the name
+ * 	       		ending at this node
+ * 	       child: a pointer to the first child
+ * 	       next: a pointer to the next sibling
+ * ***************************************************************************/
+struct TrieNode
+{
+	char c;
+	int count;
+	struct TrieNode *child;
+	struct TrieNode *next;
+};
+
+/*****************************************************************************
+ * struct PathDir
+ * Description: a PATH directory and the executables found in it when its
+ * 		mtime was last seen to change
+ * ***************************************************************************/
+struct PathDir
+{
+	char *path;
+	struct timespec mtime;
+	char **names;
+	int numNames;
+	int inPath;
+};
+
+/*****************************************************************************
+ * struct PathCache
+ * Description: the trie of executable names and the directories it was built
+ * 		from. A directory is only read again when its mtime changes.
+ * ***************************************************************************/
+struct PathCache
+{
+	struct TrieNode root;
+	struct PathDir *dirs;
+	int numDirs;
+	int capacity;
+};
+
+// Global Variable: pathCache: the executables on PATH, for tab completion
+struct PathCache pathCache = {{'\0', 0, NULL, NULL}, NULL, 0, 0};
+
+/*****************************************************************************
+ * Function: trieAdd
+ * Description: add delta to the count of name in the trie. The nodes are
+ * 		created as needed.
+ * Arguments: root: a pointer to the root of the trie
+ * 	      name: char*, the name
+ * 	      delta: int, 1 when a directory gains the name, -1 when it loses it
+ * ***************************************************************************/
+void trieAdd(struct TrieNode *root, const char *name, int delta)
+{
+	struct TrieNode *node = root;
+	for ( ; *name; name++)
+	{
+		struct TrieNode **link = &node->child;
+		while (*link && (*link)->c < *name)
+			link = &(*link)->next;
+		if (*link == NULL || (*link)->c != *name)
+		{
+			struct TrieNode *n = (struct TrieNode*)memAlloc(MEM_EDITOR, sizeof(struct TrieNode));
+			assert(n);
+			n->c = *name;
+			n->next = *link;
+			*link = n;
+		}
+		node = *link;
+	}
+	node->count += delta;
+}
+
+/*****************************************************************************
+ * Function: dropPathDir
+ * Description: remove the names of a directory from the trie and free them
+ * Argument: d: a pointer to the struct PathDir
+ * ***************************************************************************/
+void dropPathDir(struct PathDir *d)
+{
+	int i;
+	for (i=0; i < d->numNames; i++)
+	{
+		trieAdd(&pathCache.root, d->names[i], -1);
+		memFree(MEM_EDITOR, d->names[i]);
+	}
+	memFree(MEM_EDITOR, d->names);
+	d->names = NULL;
+	d->numNames = 0;
+}
+
+/*****************************************************************************
+ * Function: scanPathDir
+ * Description: read the executables of a directory and add them to the trie
+ * Argument: d: a pointer to the struct PathDir
+ * ***************************************************************************/
+void scanPathDir(struct PathDir *d)
+{
+	DIR *dir = opendir(d->path);
+	if (dir == NULL)
+		return;
+	int capacity = 64;
+	d->names = (char**)memAlloc(MEM_EDITOR, capacity * sizeof(char*));
+	assert(d->names);
+	struct dirent *de;
+	while ((de = readdir(dir)))
+	{
+		if (de->d_name[0] == '.' || de->d_type == DT_DIR)
+			continue;
+		if (faccessat(dirfd(dir), de->d_name, X_OK, 0) == -1)
+			continue;
+		if (d->numNames == capacity)
+		{
+			char **names = (char**)memAlloc(MEM_EDITOR, 2 * capacity * sizeof(char*));
+			assert(names);
+			memcpy(names, d->names, capacity * sizeof(char*));
+			memFree(MEM_EDITOR, d->names);
+			d->names = names;
+			capacity *= 2;
+		}
+		d->names[d->numNames] = (char*)memAlloc(MEM_EDITOR, strlen(de->d_name)+1);
+		assert(d->names[d->numNames]);
+		strcpy(d->names[d->numNames], de->d_name);
+		trieAdd(&pathCache.root, de->d_name, 1);
+		d->numNames++;
+	}
+	closedir(dir);
+}
+
+/*****************************************************************************
+ * Function: refreshPathCache
+ * Description: bring the trie up to date with PATH. Only the directories
+ * 		that are new or whose mtime changed are read, so this costs one
+ * 		stat per PATH directory when nothing changed.
+ * Postcondition: the trie has the executables of every PATH directory
+ * ***************************************************************************/
+void refreshPathCache()
+{
+	int i;
+	struct stat st;
+	for (i=0; i < pathCache.numDirs; i++)
+		pathCache.dirs[i].inPath = 0;
+	char *env = envGet("PATH");
+	char *path = (char*)memAlloc(MEM_EDITOR, (env ? strlen(env) : 0) + 1);
+	assert(path);
+	if (env)
+		strcpy(path, env);
+	char *token, *rest = path;
+	while ((token = strtok_r(rest, ":", &rest)))
+	{
+		for (i=0; i < pathCache.numDirs && strcmp(pathCache.dirs[i].path, token) != 0; i++)
+			;
+		if (i == pathCache.numDirs)
+		{
+			if (pathCache.numDirs == pathCache.capacity)
+			{
+				int capacity = pathCache.capacity ? 2 * pathCache.capacity : 16;
+				struct PathDir *dirs = (struct PathDir*)memAlloc(MEM_EDITOR, capacity * sizeof(struct PathDir));
+				assert(dirs);
+				if (pathCache.numDirs)
+					memcpy(dirs, pathCache.dirs, pathCache.numDirs * sizeof(struct PathDir));
+				memFree(MEM_EDITOR, pathCache.dirs);
+				pathCache.dirs = dirs;
+				pathCache.capacity = capacity;
+			}
+			struct PathDir *d = &pathCache.dirs[pathCache.numDirs++];
+			memset(d, 0, sizeof(struct PathDir));
+			d->path = (char*)memAlloc(MEM_EDITOR, strlen(token)+1);
+			assert(d->path);
+			strcpy(d->path, token);
+		}
+		struct PathDir *d = &pathCache.dirs[i];
+		d->inPath = 1;
+		if (stat(d->path, &st) == -1)
+			memset(&st.st_mtim, 0, sizeof(st.st_mtim));
+		if (d->names && st.st_mtim.tv_sec == d->mtime.tv_sec && st.st_mtim.tv_nsec == d->mtime.tv_nsec)
+			continue;
+		dropPathDir(d);
+		d->mtime = st.st_mtim;
+		scanPathDir(d);
+	}
+	memFree(MEM_EDITOR, path);
+
+	//forget the directories that were removed from PATH
+	for (i=0; i < pathCache.numDirs; )
+	{
+		if (pathCache.dirs[i].inPath)
+		{
+			i++;
+			continue;
+		}
+		dropPathDir(&pathCache.dirs[i]);
+		memFree(MEM_EDITOR, pathCache.dirs[i].path);
+		pathCache.dirs[i] = pathCache.dirs[--pathCache.numDirs];
+	}
+}
+
+/*****************************************************************************
+ * struct Candidates
+ * Description: a dynamic array of completions for the word being completed
+ * ***************************************************************************/
+struct Candidates
+{
+	char **items;
+	int size;
+	int capacity;
+};
+
+/*****************************************************************************
+ * Function: addCandidate
+ * Description: add a copy of a completion to the candidates
+ * Arguments: cands: a pointer to a struct Candidates
+ * 	      str: char*, the completion, not necessarily null terminated
+ * 	      len: int, the length of the completion
+ * ***************************************************************************/
+void addCandidate(struct Candidates *cands, const char *str, int len)
+{
+	if (cands->size == cands->capacity)
+	{
+		int capacity = cands->capacity ? 2 * cands->capacity : 16;
+		char **items = (char**)memAlloc(MEM_EDITOR, capacity * sizeof(char*));
+		assert(items);
+		if (cands->size)
+			memcpy(items, cands->items, cands->size * sizeof(char*));
+		memFree(MEM_EDITOR, cands->items);
+		cands->items = items;
+		cands->capacity = capacity;
+	}
+	cands->items[cands->size] = (char*)memAlloc(MEM_EDITOR, len + 1);
+	assert(cands->items[cands->size]);
+	memcpy(cands->items[cands->size], str, len);
+	cands->size++;
+}
+
+/*****************************************************************************
+ * Function: freeCandidates
+ * Description: free the completions and the array of the candidates
+ * Argument: cands: a pointer to a struct Candidates
+ * Postcondition: cands is empty and can be used again
+ * ***************************************************************************/
+void freeCandidates(struct Candidates *cands)
+{
+	int i;
+	for (i=0; i < cands->size; i++)
+		memFree(MEM_EDITOR, cands->items[i]);
+	memFree(MEM_EDITOR, cands->items);
+	cands->items = NULL;
+	cands->size = cands->capacity = 0;
+}
+
+/*****************************************************************************
+ * Function: collectTrie
+ * Description: add every name below node to cands, in sorted order
+ * Arguments: node: a pointer to a struct TrieNode
+ * 	      word: char*, a buffer holding the name up to node
+ * 	      len: int, the length of the name up to node
+ * 	      cands: a pointer to struct Candidates
+ * ***************************************************************************/
+void collectTrie(struct TrieNode *node, char *word, int len, struct Candidates *cands)
+{
+	if (node->count > 0)
+		addCandidate(cands, word, len);
+	if (len >= 255)
+		return;
+	for (node = node->child; node; node = node->next)
+	{
+		word[len] = node->c;
+		collectTrie(node, word, len + 1, cands);
+	}
+}
+
+/*****************************************************************************
+ * Function: findCompletions
+ * Description: find the completions of a word. The first word of the line is
+ * 		completed from the executables on PATH and the built-ins; other
+ * 		words, and words with a '/', are completed from file names.
+ * Arguments: word: char*, the word, not necessarily null terminated
+ * 	      len: int, the length of the word
+ * 	      first: int, 1 if it is the first word of the line
+ * 	      cands: a pointer to an empty struct Candidates
+ * ***************************************************************************/
+void findCompletions(const char *word, int len, int first, struct Candidates *cands)
+{
+	static const char *BUILTINS[] = {"cd", "status", "exit", "memo", "tasks", "timeout", "jobs", "memstats",
+		"export", "unset", "tee"};
+	char buf[256];
+	int i;
+	if (len >= (int)sizeof(buf))
+		return;
+	memcpy(buf, word, len);
+	buf[len] = '\0';
+	if (first && memchr(word, '/', len) == NULL)
+	{
+		for (i=0; i < (int)(sizeof(BUILTINS) / sizeof(BUILTINS[0])); i++)
+			if (strncmp(BUILTINS[i], buf, len) == 0)
+				addCandidate(cands, BUILTINS[i], strlen(BUILTINS[i]));
+		refreshPathCache();
+		struct TrieNode *node = &pathCache.root;
+		for (i=0; i < len && node; i++)
+		{
+			for (node = node->child; node && node->c != buf[i]; node = node->next)
+				;
+		}
+		if (node)
+			collectTrie(node, buf, len, cands);
+		return;
+	}
+	//complete a file name in the directory part of the word
+	char *slash = strrchr(buf, '/');
+	const char *dirName = slash ? (slash == buf ? "/" : buf) : ".";
+	const char *base = slash ? slash + 1 : buf;
+	int dirLen = slash ? slash - buf + 1 : 0;
+	if (slash && slash != buf)
+		*slash = '\0';
+	DIR *dir = opendir(dirName);
+	if (dir == NULL)
+		return;
+	struct dirent *de;
+	char name[512];
+	while ((de = readdir(dir)))
+	{
+		if (strncmp(de->d_name, base, strlen(base)) != 0 || strcmp(de->d_name, ".") == 0
+			|| strcmp(de->d_name, "..") == 0 || (base[0] != '.' && de->d_name[0] == '.'))
+			continue;
+		int n = snprintf(name, sizeof(name), "%.*s%s%s", dirLen, word, de->d_name,
+			de->d_type == DT_DIR ? "/" : "");
+		if (n < (int)sizeof(name))
+			addCandidate(cands, name, n);
+	}
+	closedir(dir);
+}
+
+/*****************************************************************************
+ * struct LineBuffer
+ * Description: the line being edited
+ * Attributes: buf: char*, the chars of the line, null terminated
+ * 	       len: int, the length of the line
+ * 	       pos: int, the position of the cursor
+ * 	       capacity: int, the size of buf
+ * ***************************************************************************/
+struct LineBuffer
+{
+	char *buf;
+	int len;
+	int pos;
+	int capacity;
+};
+
+/*****************************************************************************
+ * Function: insertText
+ * Description: insert n chars at the cursor and move the cursor after them
+ * ***************************************************************************/
+void insertText(struct LineBuffer *lb, const char *text, int n)
+{
+	if (lb->len + n + 2 > lb->capacity)
+	{
+		while (lb->len + n + 2 > lb->capacity)
+			lb->capacity *= 2;
+		lb->buf = (char*)realloc(lb->buf, lb->capacity);
+		assert(lb->buf);
+	}
+	memmove(lb->buf + lb->pos + n, lb->buf + lb->pos, lb->len - lb->pos + 1);
+	memcpy(lb->buf + lb->pos, text, n);
+	lb->len += n;
+	lb->pos += n;
+}
+
+/*****************************************************************************
+ * Function: setText
+ * Description: replace the whole line with n chars and put the cursor at the end
+ * ***************************************************************************/
+void setText(struct LineBuffer *lb, const char *text, int n)
+{
+	lb->len = lb->pos = 0;
+	lb->buf[0] = '\0';
+	insertText(lb, text, n);
+}
+
+/*****************************************************************************
+ * Function: isContinuation
+ * Description: check whether a byte is a UTF-8 continuation byte, i.e. the
+ * 		second or later byte of a multi-byte character
+ * Argument: b: the byte
+ * Return value: 1 for a continuation byte, otherwise 0
+ * ***************************************************************************/
+int isContinuation(char b)
+{
+	return ((unsigned char)b & 0xC0) == 0x80;
+}
+
+/*****************************************************************************
+ * Function: countColumns
+ * Description: count the screen columns taken by the first len bytes of a
+ * 		string, one per UTF-8 character
+ * Arguments: s: the string
+ * 	      len: the number of bytes
+ * Return value: the number of columns
+ * ***************************************************************************/
+int countColumns(const char *s, int len)
+{
+	int i, col = 0;
+	for (i=0; i < len; i++)
+		if (!isContinuation(s[i]))
+			col++;
+	return col;
+}
+
+/*****************************************************************************
+ * Function: refreshLine
+ * Description: redraw the prompt and the line, and put the cursor at pos.
+ * 		It is done with a single write to avoid flicker.
+ * Arguments: prompt: char*, the prompt
+ * 	      text: char*, the text after the prompt
+ * 	      len: int, the length of text
+ * 	      pos: int, the position of the cursor in text
+ * ***************************************************************************/
+void refreshLine(const char *prompt, const char *text, int len, int pos)
+{
+	int size = strlen(prompt) + len + 32;
+	char *out = (char*)malloc(size);
+	assert(out);
+	int n = snprintf(out, size, "\r%s%.*s\033[K\r", prompt, len, text);
+	int col = countColumns(prompt, strlen(prompt)) + countColumns(text, pos);
+	if (col > 0)
+		n += snprintf(out + n, size - n, "\033[%dC", col);
+	write(STDOUT_FILENO, out, n);
+	free(out);
+}
+
+/*****************************************************************************
+ * Function: completeLine
+ * Description: tab completion. The word before the cursor is replaced with the
+ * 		longest common prefix of its completions. A single completion is
+ * 		followed by a space. When nothing can be added, the completions are
+ * 		listed below the line.
+ * Argument: lb: a pointer to the struct LineBuffer
+ * ***************************************************************************/
+void completeLine(struct LineBuffer *lb)
+{
+	int start = lb->pos, i;
+	while (start > 0 && lb->buf[start-1] != ' ')
+		start--;
+	int first = 1;
+	for (i=0; i < start; i++)
+		if (lb->buf[i] != ' ')
+			first = 0;
+	struct Candidates cands = {NULL, 0, 0};
+	findCompletions(lb->buf + start, lb->pos - start, first, &cands);
+	if (cands.size == 0)
+	{
+		write(STDOUT_FILENO, "\a", 1);
+		return;
+	}
+	int common = strlen(cands.items[0]);
+	for (i=1; i < cands.size; i++)
+	{
+		int j = 0;
+		while (j < common && cands.items[i][j] == cands.items[0][j])
+			j++;
+		common = j;
+	}
+	int wordLen = lb->pos - start;
+	if (common > wordLen)
+		insertText(lb, cands.items[0] + wordLen, common - wordLen);
+	if (cands.size == 1 && cands.items[0][common-1] != '/')
+		insertText(lb, " ", 1);
+	else if (cands.size > 1 && common == wordLen)
+	{
+		write(STDOUT_FILENO, "\n", 1);
+		for (i=0; i < cands.size && i < 200; i++)
+		{
+			write(STDOUT_FILENO, cands.items[i], strlen(cands.items[i]));
+			write(STDOUT_FILENO, i % 6 == 5 ? "\n" : "  ", i % 6 == 5 ? 1 : 2);
+		}
+		if (cands.size > 200)
+			write(STDOUT_FILENO, "...", 3);
+		write(STDOUT_FILENO, "\n", 1);
+	}
+	freeCandidates(&cands);
+}
+
+/*****************************************************************************
+ * Function: searchHistory
+ * Description: find the newest history line before index from that contains
+ * 		query
+ * Arguments: query: char*, the text to search for
+ * 	      from: int, the search starts at from - 1
+ * Return value: the index of the line, or -1 if there is none
+ * ***************************************************************************/
+int searchHistory(const char *query, int from)
+{
+	int i, qlen = strlen(query);
+	for (i = from - 1; i >= 0; i--)
+		if (memmem(history.lines[i], history.lens[i], query, qlen))
+			return i;
+	return -1;
+}
+
+/*****************************************************************************
+ * Function: readKey
+ * Description: read one byte from the terminal. While waiting, the deadlines
+ * 		of the jobs are enforced.
+ * Arguments: children: a pointer to the job table
+ * 	      c: char*, the byte is stored here
+ * Return value: 1 if a byte was read, 0 at the end of the input, -1 on error
+ * ***************************************************************************/
+int readKey(struct ChildrenPids *children, char *c)
+{
+	while (1)
+	{
+		pollTimers(children, STDIN_FILENO, NULL, -1);
+		ssize_t n = read(STDIN_FILENO, c, 1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		return n;
+	}
+}
+
+/*****************************************************************************
+ * Function: editLine
+ * Description: read a line from the terminal with line editing. The terminal
+ * 		is put in raw mode while the line is edited.
+ * 		Keys: left/right, Home/End, ^A/^E move; Backspace, Delete, ^U, ^K,
+ * 		^W delete; up/down walk the history; ^R searches the history;
+ * 		Tab completes; ^C drops the line; ^D on an empty line ends input;
+ * 		^Z raises SIGTSTP as it would in cooked mode.
+ * 		Multi-byte UTF-8 characters are moved over and deleted as a unit.
+ * Arguments: line: char**, set to a malloc'd copy of the line ending in '\n'
+ * 	      children: a pointer to the job table
+ * Return value: the length of the line, or -1 at the end of the input
+ * ***************************************************************************/
+int editLine(char **line, struct ChildrenPids *children)
+{
+	const char *prompt = ": ";
+	struct termios orig, raw;
+	if (history.fd == -2)
+		openHistory();
+	if (tcgetattr(STDIN_FILENO, &orig) == -1)
+		return -1;
+	raw = orig;
+	raw.c_iflag &= ~(ICRNL | IXON);
+	//without ISIG, ^C and ^Z arrive as keys; SIGINT is ignored by the shell anyway
+	raw.c_lflag &= ~(ICANON | ECHO | IEXTEN | ISIG);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	//TCSADRAIN keeps what was typed ahead while the last command ran
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+	struct LineBuffer lb;
+	lb.capacity = 128;
+	lb.buf = (char*)malloc(lb.capacity);
+	assert(lb.buf);
+	lb.buf[0] = '\0';
+	lb.len = lb.pos = 0;
+	char *saved = NULL; // the line being typed while the history is browsed
+	int histIndex = history.size, result = 0;
+	char c, seq[3];
+
+	while (1)
+	{
+		int n = readKey(children, &c);
+		if (n <= 0)
+		{
+			result = -1;
+			break;
+		}
+		if (c == '\r' || c == '\n')
+		{
+			write(STDOUT_FILENO, "\n", 1);
+			break;
+		}
+		else if (c == 4 && lb.len == 0)  // ^D
+		{
+			write(STDOUT_FILENO, "\n", 1);
+			result = -1;
+			break;
+		}
+		else if (c == 3)  // ^C
+		{
+			write(STDOUT_FILENO, "^C\n", 3);
+			lb.len = lb.pos = 0;
+			lb.buf[0] = '\0';
+			histIndex = history.size;
+		}
+		else if (c == 26)  // ^Z still switches the foreground-only mode
+		{
+			write(STDOUT_FILENO, "\n", 1);
+			raise(SIGTSTP);
+		}
+		else if (c == 127 || c == 8)  // Backspace
+		{
+			int start = lb.pos;
+			while (start > 0 && isContinuation(lb.buf[--start]))
+				;
+			memmove(lb.buf + start, lb.buf + lb.pos, lb.len - lb.pos + 1);
+			lb.len -= lb.pos - start;
+			lb.pos = start;
+		}
+		else if (c == 1)  // ^A
+			lb.pos = 0;
+		else if (c == 5)  // ^E
+			lb.pos = lb.len;
+		else if (c == 11)  // ^K
+		{
+			lb.len = lb.pos;
+			lb.buf[lb.len] = '\0';
+		}
+		else if (c == 21)  // ^U
+		{
+			memmove(lb.buf, lb.buf + lb.pos, lb.len - lb.pos + 1);
+			lb.len -= lb.pos;
+			lb.pos = 0;
+		}
+		else if (c == 23)  // ^W
+		{
+			int start = lb.pos;
+			while (start > 0 && lb.buf[start-1] == ' ')
+				start--;
+			while (start > 0 && lb.buf[start-1] != ' ')
+				start--;
+			memmove(lb.buf + start, lb.buf + lb.pos, lb.len - lb.pos + 1);
+			lb.len -= lb.pos - start;
+			lb.pos = start;
+		}
+		else if (c == '\t')
+			completeLine(&lb);
+		else if (c == 18)  // ^R
+		{
+			char query[256];
+			int qlen = 0, match = history.size, found = history.size;
+			query[0] = '\0';
+			while (1)
+			{
+				char status[320];
+				const char *text = found < history.size ? history.lines[found] : "";
+				int tlen = found < history.size ? history.lens[found] : 0;
+				snprintf(status, sizeof(status), "(reverse-i-search)`%s': ", query);
+				refreshLine(status, text, tlen, 0);
+				if (readKey(children, &c) <= 0)
+					break;
+				if (c == 18)
+					match = found;
+				else if ((c == 127 || c == 8) && qlen > 0)
+					query[--qlen] = '\0';
+				else if ((unsigned char)c >= 32 && c != 127 && qlen < (int)sizeof(query) - 1)
+				{
+					query[qlen++] = c;
+					query[qlen] = '\0';
+					match = found < history.size ? found + 1 : history.size;
+				}
+				else
+					break;
+				int i = searchHistory(query, match);
+				if (i >= 0)
+					found = i;
+				else if (c == 18 || qlen == 0)
+					write(STDOUT_FILENO, "\a", 1);
+			}
+			if (found < history.size)
+				setText(&lb, history.lines[found], history.lens[found]);
+			if (c == '\r' || c == '\n')
+			{
+				refreshLine(prompt, lb.buf, lb.len, lb.len);
+				write(STDOUT_FILENO, "\n", 1);
+				break;
+			}
+		}
+		else if (c == 27)  // escape sequence
+		{
+			if (readKey(children, &seq[0]) <= 0 || readKey(children, &seq[1]) <= 0)
+				continue;
+			if (seq[0] != '[')
+				continue;
+			if (seq[1] >= '0' && seq[1] <= '9')
+			{
+				if (readKey(children, &seq[2]) <= 0)
+					continue;
+				if (seq[1] == '3' && seq[2] == '~' && lb.pos < lb.len)  // Delete
+				{
+					int end = lb.pos + 1;
+					while (end < lb.len && isContinuation(lb.buf[end]))
+						end++;
+					memmove(lb.buf + lb.pos, lb.buf + end, lb.len - end + 1);
+					lb.len -= end - lb.pos;
+				}
+			}
+			else if (seq[1] == 'C' && lb.pos < lb.len)
+			{
+				lb.pos++;
+				while (lb.pos < lb.len && isContinuation(lb.buf[lb.pos]))
+					lb.pos++;
+			}
+			else if (seq[1] == 'D' && lb.pos > 0)
+			{
+				while (lb.pos > 0 && isContinuation(lb.buf[--lb.pos]))
+					;
+			}
+			else if (seq[1] == 'H')
+				lb.pos = 0;
+			else if (seq[1] == 'F')
+				lb.pos = lb.len;
+			else if (seq[1] == 'A' && histIndex > 0)
+			{
+				if (histIndex == history.size)
+					saved = strdup(lb.buf);
+				histIndex--;
+				setText(&lb, history.lines[histIndex], history.lens[histIndex]);
+			}
+			else if (seq[1] == 'B' && histIndex < history.size)
+			{
+				histIndex++;
+				if (histIndex == history.size)
+				{
+					setText(&lb, saved ? saved : "", saved ? strlen(saved) : 0);
+					free(saved);
+					saved = NULL;
+				}
+				else
+					setText(&lb, history.lines[histIndex], history.lens[histIndex]);
+			}
+		}
+		else if ((unsigned char)c >= 32)  // printable ASCII and UTF-8 bytes
+			insertText(&lb, &c, 1);
+		refreshLine(prompt, lb.buf, lb.len, lb.pos);
+	}
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+	free(saved);
+	if (result == -1)
+	{
+		free(lb.buf);
+		*line = NULL;
+		return -1;
+	}
+	saveHistory(lb.buf, lb.len);
+	lb.buf[lb.len++] = '\n';
+	lb.buf[lb.len] = '\0';
+	*line = lb.buf;
+	return lb.len;
+}
+
+/*****************************************************************************
+ * Function: readline
+ * Description: read a line of user input. It will read a line despite signal
+ * 		interruptions. On a terminal the line is read with editLine.
+ * Argument: line: char*
+ * 	     children: a pointer to the job table, whose deadlines are enforced
+ * 	     		while the user types
+ * Precondition: char* is NULL or not initialized.
+ * Postcondition: char* is allocated and filled with user input, or NULL at the
+ * 		  end of the input
+ * Return value: the size of the input, or -1 at the end of the input
+ * ***************************************************************************/
+int readLine(char **line, struct ChildrenPids *children)
+{
+	*line = NULL;
+	if (isatty(STDIN_FILENO))
+	{
+		int length = editLine(line, children);
+		memTrack(MEM_INPUT, *line);
+		return length;
+	}
+	int numCharsEntered = -5;
+	size_t bufferSize = 0;
+	while (1)
+	{
+		numCharsEntered = getline(line, &bufferSize, stdin);
+		if (numCharsEntered != -1)
+			break;  //exit loop. The input is valid.
+		if (feof(stdin))
+		{
+			free(*line);
+			*line = NULL;
+			return -1;
+		}
+		clearerr(stdin);
+	}
+	memTrack(MEM_INPUT, *line);
+
+	return numCharsEntered;
+}
+
+/***********************************************************************************
+ * Function: expandShellPid
+ * Description: this function replaces "$$" in the string to the pid of the current
+ * 		process.
+ * Argument: str, char*
+ * Precondition: str has "$$"
+ * Postcondition: "$$" is replaced with pid
+ * Return value: a char* pointed to a string that has pid
+ * ********************************************************************************/
+char* expandShellPid(char* str)
+{
+	char* pos = strstr(str, "$$");
+	char* newStr = (char*)memAlloc(MEM_EXPAND, strlen(str)+10); //return string
+	char pidStr[8]; //char string of pid
+	memset(pidStr, '\0', 8);
+	sprintf(pidStr, "%d", getpid());
+	char* i;
+	int j, k;
+	for (i = str, j=0; i < pos; i++, j++) //copy over every char of str before $$
+		newStr[j] = *i;
+	for (k=0; k<strlen(pidStr); k++, j++) //copy over pid
+		newStr[j] = pidStr[k];
+	i += 2;  //copy over every char of str after $$
+	for ( ;i < str+strlen(str); i++, j++)
+		newStr[j] = *i;
+	return newStr;
+}
+
+/***********************************************************************************
+ * Function: expandAllShellPid
+ * Description: this function replaces every "$$" in the string with the pid of the
+ * 		current process.
+ * Argument: str, char*
+ * Precondition: str has "$$"
+ * Return value: a char* allocated for MEM_EXPAND that has the pid
+ * ********************************************************************************/
+char* expandAllShellPid(char* str)
+{
+	char *expanded = expandShellPid(str);
+	while (strstr(expanded, "$$") != 0)
+	{
+		char *temp = expandShellPid(expanded);
+		memFree(MEM_EXPAND, expanded);
+		expanded = temp;
+	}
+	return expanded;
+}
+
+
+// Global Variable: deferExpansion: int. 1 means parseLine and readHereDocs keep
+// "$$" as it is, so that a compiled script can expand it when it is run.
+int deferExpansion = 0;
+
+/*******************************************************************************
+ * Function: parseLine
+ * Description: parse the input line into words and store the words in struct
+ * 		CommandLine. A word of the form [N]<, [N]>, [N]>> followed by a
+ * 		file name (in the same word or the next one), or [N]>&M, [N]<&M or
+ * 		[N]>&- is stored as a redirection. N defaults to 0 for < and to 1
+ * 		for >. [N]<<<word feeds word and a newline to N, and [N]<<DELIM
+ * 		starts a here-document whose body is read later by readHereDocs.
+ * 		A malformed redirection is reported and marks the whole line
+ * 		invalid; the rest of the line is still parsed so that its
+ * 		here-documents are read.
+ * Argument: line: a char* to be parsed
+ * Precondition: line is composed of words separated by spaces. It doesn't have an
+ * 		ending '\n'.
+ * Postcondition: line is altered by strtok
+ * Return value: a pointer to a dynamically allocated strct CommandLine that stores
+ * 		 the words of the line, the input and output, and whether or not
+ * 		 background process
+ * *****************************************************************************/
+struct CommandLine*  parseLine(char* line)
+{	
+	char* token = NULL; // set null pointer
+	char* rest = line;
+
+	struct CommandLine* commands = (struct CommandLine*)memAlloc(MEM_PARSER, sizeof(struct CommandLine));
+	assert(commands);
+	initCommandLine(commands,10);
+	while ((token = strtok_r(rest, " ", &rest)))
+	{	
+		char *op = token;
+		while (*op >= '0' && *op <= '9')
+			op++;
+		if ((*op == '<' || *op == '>') && (op == token || op - token < 4))  //a redirection
+		{
+			int fd = op == token ? (*op == '<' ? 0 : 1) : atoi(token);
+			int type = *op == '<' ? REDIR_IN : REDIR_OUT;
+			op++;
+			if (type == REDIR_OUT && *op == '>')
+			{
+				type = REDIR_APPEND;
+				op++;
+			}
+			else if (type == REDIR_IN && *op == '<')
+			{
+				type = op[1] == '<' ? REDIR_DATA : REDIR_HEREDOC;
+				op += type == REDIR_DATA ? 2 : 1;
+			}
+			if (*op == '&' && (type == REDIR_IN || type == REDIR_OUT))
+			{
+				if (strcmp(op + 1, "-") == 0)
+					addRedirect(commands, REDIR_CLOSE, fd, -1, NULL);
+				else if (op[1] >= '0' && op[1] <= '9')
+					addRedirect(commands, REDIR_DUP, fd, atoi(op + 1), NULL);
+				else
+				{
+					fprintf(stderr, "bad redirection %s\n", token);
+					commands->invalid = 1;
+				}
+				continue;
+			}
+			char *target = *op ? op : strtok_r(rest, " ", &rest);
+			if (target == NULL)
+			{
+				fprintf(stderr, "missing file name after %s\n", token);
+				commands->invalid = 1;
+				continue;
+			}
+			if (type == REDIR_HEREDOC)
+			{
+				addRedirect(commands, type, fd, -1, target);
+				continue;
+			}
+			char *expanded = !deferExpansion && strstr(target, "$$") ? expandAllShellPid(target) : NULL;
+			if (type == REDIR_DATA)
+			{
+				//a here-string is the word followed by a newline
+				const char *word = expanded ? expanded : target;
+				char *text = (char*)memAlloc(MEM_PARSER, strlen(word)+2);
+				assert(text);
+				sprintf(text, "%s\n", word);
+				addRedirect(commands, type, fd, -1, text);
+				memFree(MEM_PARSER, text);
+			}
+			else
+				addRedirect(commands, type, fd, -1, expanded ? expanded : target);
+			memFree(MEM_EXPAND, expanded);
+			continue;
+		}
+		if (!deferExpansion && strstr(token, "$$") != 0)  //expand "$$" and add the command to the struct
+		{
+			char *expanded = expandAllShellPid(token);
+			addCommandLine(commands, expanded);
+			memFree(MEM_EXPAND, expanded);
+			continue;
+		}
+		addCommandLine(commands,token);
+	}
+	
+	// Set up for the background process
+	if (commands->size > 0)
+	{
+		if(strcmp("&", commands->arr[commands->size - 1]) == 0)
+		{
+			commands->bg = 1;
+			memFree(MEM_PARSER, commands->arr[commands->size-1]);
+			commands->arr[commands->size-1] = NULL;
+			commands->size--;
+			// if no input or output is provided, then set them to /dev/null.
+			// They go first so that the redirections typed by the user are
+			// applied on top of them.
+			int hasInput = findRedirect(commands, 0) != NULL;
+			int hasOutput = findRedirect(commands, 1) != NULL;
+			if (!hasInput)
+				addRedirect(commands, REDIR_IN, 0, -1, "/dev/null");
+			if (!hasOutput)
+				addRedirect(commands, REDIR_OUT, 1, -1, "/dev/null");
+			int added = !hasInput + !hasOutput;
+			if (added && commands->numRedirs > added)
+			{
+				struct Redirect temp[2];
+				memcpy(temp, commands->redirs + commands->numRedirs - added, added * sizeof(struct Redirect));
+				memmove(commands->redirs + added, commands->redirs, (commands->numRedirs - added) * sizeof(struct Redirect));
+				memcpy(commands->redirs, temp, added * sizeof(struct Redirect));
+			}
+
+		}
+	}
+	return commands;
+}
+
+/*******************************************************************************
+ * Function: isComment
+ * Description: check if a command line is a comment, i.e. its first word after
+ * 		any NAME=value words starts with '#'
+ * Argument: c: a pointer to a struct CommandLine returned by parseLine
+ * Return value: 1 if it is a comment, 0 otherwise
+ * *****************************************************************************/
+int isComment(struct CommandLine *c)
+{
+	int i = 0;
+	while (i < c->size && assignmentLength(c->arr[i]) > 0)
+		i++;
+	return i < c->size && c->arr[i][0] == '#';
+}
+
+/*******************************************************************************
+ * Function: readHereDocs
+ * Description: read the bodies of the here-documents of a command from the
+ * 		input, one line at a time, until a line that is just the delimiter.
+ * 		"$$" in the body is expanded. Each REDIR_HEREDOC becomes a
+ * 		REDIR_DATA holding its body.
+ * Argument: c: a pointer to a struct CommandLine returned by parseLine
+ * 	     in: the input the command line was read from
+ * Precondition: the command line itself has already been read and is not a
+ * 		comment, whose "<<" must not swallow the lines after it
+ * Postcondition: the lines of the bodies are consumed from in
+ * *****************************************************************************/
+void readHereDocs(struct CommandLine *c, FILE *in)
+{
+	int i;
+	for (i=0; i < c->numRedirs; i++)
+	{
+		struct Redirect *r = &c->redirs[i];
+		if (r->type != REDIR_HEREDOC)
+			continue;
+		size_t size = 0, capacity = 256;
+		char *body = (char*)memAlloc(MEM_PARSER, capacity);
+		assert(body);
+		char *line = NULL;
+		size_t bufferSize = 0;
+		ssize_t n;
+		while (1)
+		{
+			if (in == stdin && isatty(STDIN_FILENO))
+			{
+				printf("> ");
+				fflush(stdout);
+			}
+			n = getline(&line, &bufferSize, in);
+			if (n == -1)
+			{
+				if (!feof(in) && errno == EINTR)
+				{
+					clearerr(in);
+					continue;
+				}
+				fprintf(stderr, "here-document ended by end of input (wanted %s)\n", r->target);
+				break;
+			}
+			if (n > 0 && line[n-1] == '\n')
+				line[--n] = '\0';
+			if (strcmp(line, r->target) == 0)
+				break;
+			char *expanded = !deferExpansion && strstr(line, "$$") ? expandAllShellPid(line) : NULL;
+			const char *text = expanded ? expanded : line;
+			size_t len = strlen(text);
+			if (size + len + 2 > capacity)
+			{
+				while (size + len + 2 > capacity)
+					capacity *= 2;
+				char *temp = (char*)memAlloc(MEM_PARSER, capacity);
+				assert(temp);
+				memcpy(temp, body, size);
+				memFree(MEM_PARSER, body);
+				body = temp;
+			}
+			memcpy(body + size, text, len);
+			size += len;
+			body[size++] = '\n';
+			body[size] = '\0';
+			memFree(MEM_EXPAND, expanded);
+		}
+		free(line);
+		memFree(MEM_PARSER, r->target);
+		r->target = body;
+		r->type = REDIR_DATA;
+	}
+}
+
+
+
+/*******************************************************************
+ * Function: cdHandle
+ * Description: built-in shell function. If the user type in cd,
+ * 		then this function is invoked. If the user typed 
+ * 		in the directory, then the current working directory
+ * 		is changed to it. Otherwise, the directory is changed
+ * 		to the environment variable HOME. The exit value is 0
+ * 		if the directory is successfully changed. Otherwise
+ * 		the exit value is 1.
+ * Argument: c: a pointer to a struct CommandLine that has the info
+ * 		for cd command.
+ * Precondition: N/A
+ * Postcondition: the current working directory is changed to either
+ * 		  the one specified by the user, or HOME. PWD is updated.
+ * ******************************************************************/
+void cdHandle(struct CommandLine *c)
+{
+	int result;
+	const char *path;
+	if (c->size == 1)   //If there is only one command cd
+	{	//get $HOME from the environment store
+		path = envGet("HOME");
+		if (path == NULL)
+		{
+			fprintf(stderr, "cd error: HOME not set\n");
+			return;
+		}
+	}
+	else
+	{
+		path = c->arr[1];
+	}
+
+	result = chdir(path);
+	if (result == -1)
+	{
+		perror("cd error");
+		return;
+	}
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)))
+		envSet("PWD", 3, cwd);
+}
+
+/*******************************************************************
+ * Function: exportHandle
+ * Description: built-in shell function. "export NAME=value ..." sets
+ * 		the variables in the environment of the shell and of
+ * 		the commands it runs. "export" alone prints them all.
+ * Argument: c: a pointer to a struct CommandLine for the export command
+ * Precondition: c->arr[0] is "export"
+ * Postcondition: the variables are set in the environment store.
+ * ******************************************************************/
+void exportHandle(struct CommandLine *c)
+{
+	int i;
+	if (c->size == 1)
+	{
+		char **p;
+		for (p = envEnvp(); *p; p++)
+			printf("export %s\n", *p);
+		fflush(stdout);
+		return;
+	}
+	for (i=1; i < c->size; i++)
+	{
+		int len = assignmentLength(c->arr[i]);
+		if (len > 0)
+			envSet(c->arr[i], len, c->arr[i] + len + 1);
+		else if (strchr(c->arr[i], '=') != NULL)
+			fprintf(stderr, "export: not a valid name: %s\n", c->arr[i]);
+		//"export NAME" is accepted; every variable is exported already
+	}
+}
+
+/*******************************************************************
+ * Function: unsetHandle
+ * Description: built-in shell function. "unset NAME ..." removes the
+ * 		variables from the environment store.
+ * Argument: c: a pointer to a struct CommandLine for the unset command
+ * Precondition: c->arr[0] is "unset"
+ * Postcondition: the variables are not set.
+ * ******************************************************************/
+void unsetHandle(struct CommandLine *c)
+{
+	int i;
+	for (i=1; i < c->size; i++)
+		envUnset(c->arr[i]);
+}
+
+/*******************************************************************************
+ * Function: exitHandle
+ * Description: This is a built-in shell function. When the user typed in exit,
+ * 		then this function is invoked. It kills all the processes or jobs the 
+ * 		shell has not finished.
+ * Argument: children, a pointer to a struct ChildrenPids that stores all the
+ * 	     pids of the children process that are still running.
+ * Precondition: N/A
+ * Postcondition: all the children processes are killed.
+ * ****************************************************************************/
+void exitHandle(struct ChildrenPids *children)
+{	
+	struct Link* temp;
+	int result;
+	int i=0;
+	while (children->size != 0 && i < 50)
+	{
+		temp = children->list;
+		result = kill(temp->pidNo, SIGTERM);
+		if (result == 0)
+		{
+			printf("Process %d terminated by SIGTERM\n", temp->pidNo);
+			fflush(stdout);
+			int deleted = deleteChildrenPids(children, temp->pidNo);
+			if (deleted == 0)
+			{
+				printf("Sucessfully deleted info for this process\n");
+				fflush(stdout);
+			}
+			else
+			{
+				printf("Error deleting info for this process\n");
+				fflush(stdout);
+			}
+
+		}
+		else
+		{
+			perror("Exit Failure: ");
+		}
+		i++;
+	}
+}
+
+/*******************************************************************************************
+ * Function: statusHandle
+ * Description: This function prints to the terminal the exit status or the terminating signal
+ * 		of the last foreground process ran by the shell. A process killed at its deadline
+ * 		is reported as timed out.
+ * Argument: exitMethod: int, the exit method of the last foreground process
+ * 	     timedOut: int, 1 if the last foreground process passed its deadline
+ * Precondition: N/A
+ * Postcondition: The exit status or terminating signal is printed to the terminal.
+ * ******************************************************************************************/
+void statusHandle(int exitMethod, int timedOut)
+{
+	if (timedOut)
+		printf("timed out, ");
+	if (WIFEXITED(exitMethod) != 0)   //child exited normally
+	{
+		int exitStatus = WEXITSTATUS(exitMethod);
+		if (exitStatus != 0)
+			exitStatus = 1;
+		printf("exit value %d\n",exitStatus);
+		fflush(stdout);
+	}		
+	else if (WIFSIGNALED(exitMethod) != 0) //child terminated by a signal
+	{	
+		printf("terminated by signal %d\n", WTERMSIG(exitMethod));
+		fflush(stdout);
+	}
+}
+
+
+/*********************************************************************************
+ * Function: openData
+ * Description: This function makes a file descriptor that reads the given text.
+ * 		Text up to PIPE_BUF bytes is written into a pipe, which never blocks.
+ * 		Longer text is written once into a memfd that is then sealed, so the
+ * 		command can read or mmap it but nobody can change it.
+ * Argument: text: char*, the text
+ * Return value: the file descriptor, positioned at the start, or -1 on error
+ * ******************************************************************************/
+int openData(const char *text)
+{
+	size_t len = strlen(text), off = 0;
+	ssize_t n;
+	if (len <= PIPE_BUF)
+	{
+		int pipeFDs[2];
+		if (pipe2(pipeFDs, O_CLOEXEC) == -1)
+			return -1;
+		if (len > 0 && write(pipeFDs[1], text, len) != (ssize_t)len)
+		{
+			close(pipeFDs[0]);
+			close(pipeFDs[1]);
+			return -1;
+		}
+		close(pipeFDs[1]);
+		return pipeFDs[0];
+	}
+	int fd = memfd_create("smallsh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1)
+		return -1;
+	while (off < len && (n = write(fd, text + off, len - off)) > 0)
+		off += n;
+	if (off < len || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1
+		|| lseek(fd, 0, SEEK_SET) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*********************************************************************************
+ * Function: applyRedirects
+ * Description: This function performs the redirections of the CommandLine in order,
+ * 		then closes every other file descriptor above 2 so that the command
+ * 		starts with only the ones it needs. The files are opened with
+ * 		O_CLOEXEC and closed after dup2, so no extra descriptor is left.
+ * 		The text of a here-document or here-string is given to the command
+ * 		through a pipe when it fits in one write, and through a sealed memfd
+ * 		otherwise, so no temporary file is written.
+ * Argument: c: a pointer to a struct Commandline that stores the redirections
+ * Precondition: it is called in the child process
+ * Return value: 0 on success, the errno of the failed call otherwise
+ * ******************************************************************************/
+int applyRedirects(struct CommandLine *c)
+{
+	int i, fd, maxFD = 2;
+	for (i=0; i < c->numRedirs; i++)
+	{
+		struct Redirect *r = &c->redirs[i];
+		if (r->fd > maxFD)
+			maxFD = r->fd;
+		if (r->type == REDIR_CLOSE)
+		{
+			close(r->fd);
+			continue;
+		}
+		if (r->type == REDIR_DUP)
+			fd = r->srcFD;
+		else if (r->type == REDIR_DATA || r->type == REDIR_HEREDOC)
+			fd = openData(r->type == REDIR_DATA ? r->target : "");
+		else if (r->type == REDIR_IN)
+			fd = open(r->target, O_RDONLY | O_CLOEXEC);
+		else if (r->type == REDIR_OUT)
+			fd = open(r->target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		else
+			fd = open(r->target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd == -1)
+			return errno;
+		if (fd == r->fd)
+		{
+			//dup2 to itself would keep O_CLOEXEC, so clear it instead
+			if (fcntl(fd, F_SETFD, 0) == -1)
+				return errno;
+		}
+		else
+		{
+			if (dup2(fd, r->fd) == -1)
+				return errno;
+			if (r->type != REDIR_DUP)
+				close(fd);
+		}
+	}
+
+	//close the descriptors that are not 0-2 or a redirection target
+	int low = 3;
+	while (low <= maxFD)
+	{
+		int high = low;
+		while (high <= maxFD && findRedirect(c, high) == NULL)
+			high++;
+		if (high > low)
+			syscall(SYS_close_range, low, high - 1, 0);
+		low = high + 1;
+	}
+	syscall(SYS_close_range, maxFD + 1, ~0U, 0);
+	return 0;
+}
+
+/*********************************************************************************
+ * Function: execHandle
+ * Dexcription: This function performs the redirections of the CommandLine, then
+ * 		calls execvp with the information in the struct CommandLine and the
+ * 		environment of the environment store
+ * Argument: c: a pointer to a struct Commandline that stores the information for
+ * 		redirection and execvp
+ * Precondition: it is called in the child process, and the parent called envEnvp
+ * 		 before fork
+ * Postcondition: The execvp runs successfully. Or the error message is output to
+ * 		  the terminal and exit with 1.
+ * Return value: N/A
+ * ******************************************************************************/
+void execHandle(struct CommandLine *c)
+{
+	int result = applyRedirects(c);
+	if (result != 0)
+		exit(result);
+
+	//execvp passes environ and searches its PATH, so point it at the store
+	environ = envStore.envp;
+	if (execvp(c->arr[0], c->arr) < 0)
+	{
+//		perror("No such command");
+//		printf("errno is %d: %s\n",  errno, strerror(errno));
+//		fflush(stdout);
+		exit(errno);
+	}
+}
+
+/*********************************************************************************
+ * Function: spawnCommand
+ * Description: This function forks a child that runs the command and adds it to
+ * 		the job table with its deadline. The child starts with no blocked
+ * 		signals, ignores SIGTSTP, and, in the foreground, is terminated by
+ * 		SIGINT. Every way the shell runs an external command goes through
+ * 		here.
+ * Arguments: c: a pointer to the struct CommandLine to run
+ * 	      children: a pointer to the job table
+ * 	      stdoutFD: int, the stdout of the command instead of its stdout
+ * 	      		redirections, or -1 to keep them
+ * 	      deadline: long, the deadline of the command in ms, or -1 for none
+ * 	      keep: int, 1 if the job table takes c and frees it with the job,
+ * 	      	    0 if the caller keeps c
+ * Return value: a pointer to the struct Link of the child
+ * ******************************************************************************/
+struct Link* spawnCommand(struct CommandLine *c, struct ChildrenPids *children, int stdoutFD, long deadline, int keep)
+{
+	envEnvp();  //build the envp of the command here, not in each child
+	fflush(stdout);
+	pid_t spawnPid = fork();
+	if (spawnPid == -1)  //fork error
+	{
+		perror("Hull Breach!");
+		exit(1);
+	}
+	else if (spawnPid == 0)  //child process
+	{
+		struct sigaction action = {{0}};
+		sigset_t none;
+		sigfillset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		if (c->bg == 0)  //a foreground process will be terminated by SIGINT
+		{
+			action.sa_handler = SIG_DFL;
+			sigaction(SIGINT, &action, NULL);
+		}
+		action.sa_handler = SIG_IGN;
+		sigaction(SIGTSTP, &action, NULL);
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		if (stdoutFD != -1)
+		{
+			if (dup2(stdoutFD, 1) == -1)
+				exit(errno);
+			removeRedirects(c, 1);
+		}
+		execHandle(c);
+	}
+	struct Link *child = addChildrenPids(children, spawnPid, keep ? c : NULL, c->bg);
+	if (deadline >= 0)
+		armTimer(child, deadline);
+	return child;
+}
+
+/*********************************************************************************
+ * Function: waitForeground
+ * Description: This function waits for a foreground child with SIGTSTP blocked,
+ * 		enforcing its deadline and those of the background processes, then
+ * 		removes it from the job table.
+ * Arguments: children: a pointer to the job table
+ * 	      pid: pid_t, the child returned by spawnCommand
+ * 	      childExitMethod: int*, the exit method of the child is stored here
+ * Return value: 1 if the child was killed at its deadline, 0 otherwise
+ * ******************************************************************************/
+int waitForeground(struct ChildrenPids *children, pid_t pid, int *childExitMethod)
+{
+	//block the SIGTSTP signal while waiting for the child process
+	sigset_t toBlock;
+	if (sigemptyset(&toBlock) == -1)
+		perror("Failed to set sigset_t toBlock");
+	if (sigaddset(&toBlock, SIGTSTP) == -1)
+		perror("Failed to add SIGTSTP to sigset_t toBlock");
+	if (sigprocmask(SIG_BLOCK, &toBlock, NULL) != 0)
+		perror("SIGTSTP is not blocked in foreground child process");
+
+	//Wait for the child to finish or to be killed at its deadline
+	waitChild(children, pid, childExitMethod);
+	struct Link *child = findChildrenPids(children, pid);
+	int timedOut = child && child->timedOut != 0;
+
+	//unblock the SIGTSTP signal
+	if (sigprocmask(SIG_UNBLOCK, &toBlock, NULL) != 0)
+		perror("SIGTSTP is not unblocked");
+
+	//clear up the command and pid saved for the child process
+	deleteChildrenPids(children, pid);
+	return timedOut;
+}
+
+void parentCatchSIGTSTP(int signo)
+{
+//	char* message = "Parent Caught SIGTSTP\n";
+//	write(STDOUT_FILENO, message, 22);
+	if (BGAllowed == 1)
+	{
+		write(STDOUT_FILENO, "Enter foreground only mode (& is ignored)\n: ",45);
+		BGAllowed = 0;
+	}
+	else
+	{
+		write(STDOUT_FILENO, "Exit foreground only mode\n: ", 28);
+		BGAllowed = 1;
+	}
+
+}
+
+/********************************************************************************************************
+ * Function: decipherExitStatus
+ * Description: determine the exit status of the passed in childExitMethod, and then store
+ * 		appropriate values in the pointed int values;
+ * Arguments: childExitMethod: int, the code returned by the terminated child process
+ * 	      exited: int*, the int pointed to will be 1 if the child exited normally. 0 otherwise
+ * 	      exitStatus: int*, the int pointed to will be the exit status if childe exited normally.
+ * 	      signaled: int*, the int pointed to will be 1 if the child exited upon a signal. 0 otherwise.
+ * 	      termSignal: in*, the int pointed to will be the signal that killed the child process.
+ * Precondition: all the input are valid.
+ * Postcondition: the deciphered information are stored in the addresses that the pointers point to.
+ * ******************************************************************************************************/
+void decipherExitStatus(int childExitMethod, int* exited, int* exitStatus, int* signaled, int* termSignal)
+{
+
+	if (WIFEXITED(childExitMethod) != 0)   //child terminated normally
+	{
+		*exited = 1;
+		*exitStatus = WEXITSTATUS(childExitMethod);
+		*signaled = 0;
+		*termSignal = 0;
+	}		
+	else if (WIFSIGNALED(childExitMethod) != 0) //child terminated by a signal
+	{	
+		*signaled = 1;
+		*termSignal = WTERMSIG(childExitMethod);
+		*exited = 0;
+		*exitStatus = 0;
+	}					
+}
+
+/**********************************************************************************************
+ * Function: checkBGChildren
+ * Description: This function checks whether the background child processes have finished. If
+ * 		yes, then it cleans them up. The processes past their deadline are signaled first.
+ * Argument: children, a pointer to a struct ChildrenPids, which stores the child processes
+ * Precondition: children has at least 1 element
+ * Postcondition: If the child process in children has finished, then it is cleaned up and removed
+ * 		  from children
+ * Return value: N/A
+ * **********************************************************************************************/
+void checkBGChildren(struct ChildrenPids *children)
+{		
+	//use an array to store the pid of the background processes
+	assert(children->size);
+	checkTimers(children);
+	pid_t *bgChildren=(pid_t*)memAlloc(MEM_JOBS, children->size * sizeof(pid_t));
+	int i=0;
+	struct Link* temp = children->list;
+	while (temp)   //copy the pids in the linked list to the array
+	{
+		bgChildren[i] = temp->pidNo;
+		temp = temp->next;
+		i++;
+	}
+	
+	//Check each pid. If it's finished, clean up.
+	int childExitMethod,exited, exitStatus, signaled, termSignal;
+	pid_t currPid;
+	for (i=0; i < children->size; i++)
+	{
+		if ((currPid = waitpid(bgChildren[i], &childExitMethod, WNOHANG)) != 0)
+		{	
+			struct Link *l = findChildrenPids(children, currPid);
+			if (l && l->timedOut)
+				printf("Background process %d timed out: ", currPid);
+			else
+				printf("Background process %d has finished: ", currPid);
+			fflush(stdout);
+			deleteChildrenPids(children, currPid);
+			//Decipher the type of termination
+			decipherExitStatus(childExitMethod, &exited, &exitStatus, &signaled, &termSignal);
+			if (exited)
+			{
+				if (exitStatus == 0)
+				{
+					printf("exit value 0\n");
+					fflush(stdout);
+				}
+				if (exitStatus != 0)
+				{
+					printf("exited value %d\n", exitStatus); 
+					fflush(stdout);
+				}
+			}
+			else if (signaled)
+			{
+				printf("terminated by signal %d\n",  termSignal);
+				fflush(stdout);
+			}
+			
+		}
+	}
+	memFree(MEM_JOBS, bgChildren);
+}
+
+/*******************************************************************************
+ * Function: reportFGExit
+ * Description: This function tells the user how a foreground process ended. A
+ * 		non-zero exit value is printed as an error message and a terminating
+ * 		signal is printed with the pid.
+ * Arguments: pid: pid_t, the pid of the foreground process
+ * 	      childExitMethod: int, the code returned by waitpid
+ * 	      timedOut: int, 1 if the process was killed at its deadline
+ * Precondition: N/A
+ * Postcondition: the message is printed to the terminal if needed.
+ * ****************************************************************************/
+void reportFGExit(pid_t pid, int childExitMethod, int timedOut)
+{
+	int exited = 0, exitStatus = 0, signaled = 0, termSignal = 0;
+	decipherExitStatus(childExitMethod, &exited, &exitStatus, &signaled, &termSignal);
+	if (timedOut)
+	{
+		printf("Foreground process %d timed out: ", pid);
+		statusHandle(childExitMethod, 0);
+	}
+	else if (exited)
+	{
+		if (exitStatus != 0)
+		{
+			printf("Error: %s\n", strerror(exitStatus));
+			fflush(stdout);
+		}
+	}
+	else if (signaled)
+	{
+		printf("Foreground process %d is terminated by signal %d\n", pid, termSignal);
+		fflush(stdout);
+	}
+}
+
+/*******************************************************************************
+ * struct MemoStats
+ * Description: the hit/miss counters of the memo cache for this shell session
+ * Attributes: hits: int, the number of commands replayed from the cache
+ * 	       misses: int, the number of commands that had to be run
+ * 	       evictions: int, the number of entries removed to stay under the cap
+ * ****************************************************************************/
+struct MemoStats
+{
+	int hits;
+	int misses;
+	int evictions;
+};
+
+// Global Variable: memoStats: the memo cache counters of this session
+struct MemoStats memoStats = {0, 0, 0};
+
+// Every cache entry starts with a fixed size header holding the exit method
+#define MEMO_HEADER_SIZE 24
+#define MEMO_DEFAULT_MAX (64L * 1024 * 1024)
+
+/*******************************************************************************
+ * Function: memoHash
+ * Description: FNV-1a hash. It folds len bytes of buf into the running hash h.
+ * Arguments: h: the hash so far
+ * 	      buf: a pointer to the bytes to be hashed
+ * 	      len: size_t, the number of bytes
+ * Return value: the new hash
+ * ****************************************************************************/
+unsigned long long memoHash(unsigned long long h, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char*)buf;
+	size_t i;
+	for (i=0; i < len; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/*******************************************************************************
+ * Function: memoHashFile
+ * Description: fold the state of a file into the hash. By default the device,
+ * 		inode, size and mtime are used. If content is 1, the bytes of the file
+ * 		are hashed instead so that touching the file does not cause a miss.
+ * Arguments: h: the hash so far
+ * 	      path: char*, the file name
+ * 	      content: int, 1 means hash the content of the file
+ * Return value: the new hash. A missing file is hashed as its errno.
+ * ****************************************************************************/
+unsigned long long memoHashFile(unsigned long long h, const char *path, int content)
+{
+	struct stat st;
+	h = memoHash(h, path, strlen(path)+1);
+	if (stat(path, &st) == -1)
+		return memoHash(h, &errno, sizeof(errno));
+	if (content == 0)
+	{
+		h = memoHash(h, &st.st_dev, sizeof(st.st_dev));
+		h = memoHash(h, &st.st_ino, sizeof(st.st_ino));
+		h = memoHash(h, &st.st_size, sizeof(st.st_size));
+		h = memoHash(h, &st.st_mtim, sizeof(st.st_mtim));
+		return h;
+	}
+	char buf[8192];
+	ssize_t n;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return memoHash(h, &errno, sizeof(errno));
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		h = memoHash(h, buf, n);
+	close(fd);
+	return h;
+}
+
+/*******************************************************************************
+ * Function: memoDir
+ * Description: find the memo cache directory and create it if it doesn't exist.
+ * 		It is SMALLSH_MEMO_DIR if set, otherwise $HOME/.smallsh_memo
+ * Arguments: dir: char*, the buffer the directory name is written to
+ * 	      size: size_t, the size of the buffer
+ * Return value: 0 on success, -1 if the directory can't be used
+ * ****************************************************************************/
+int memoDir(char *dir, size_t size)
+{
+	char *env = envGet("SMALLSH_MEMO_DIR");
+	if (env && env[0] != '\0')
+		snprintf(dir, size, "%s", env);
+	else
+		snprintf(dir, size, "%s/.smallsh_memo", envGet("HOME") ? envGet("HOME") : ".");
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+	{
+		perror("memo cache dir");
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * struct MemoEntry
+ * Description: the name, size and last use time of a cache entry. It is only
+ * 		used while scanning the cache directory.
+ * ****************************************************************************/
+struct MemoEntry
+{
+	char name[32];
+	off_t size;
+	struct timespec used;
+};
+
+/*******************************************************************************
+ * Function: compareMemoEntry
+ * Description: the qsort comparison that orders cache entries from the least to
+ * 		the most recently used
+ * Arguments: a, b: pointers to the struct MemoEntry to compare
+ * Return value: negative if a was used before b, positive if after, 0 if at the
+ * 		 same time
+ * ****************************************************************************/
+int compareMemoEntry(const void *a, const void *b)
+{
+	const struct MemoEntry *x = (const struct MemoEntry*)a, *y = (const struct MemoEntry*)b;
+	if (x->used.tv_sec != y->used.tv_sec)
+		return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+	if (x->used.tv_nsec != y->used.tv_nsec)
+		return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+	return 0;
+}
+
+/*******************************************************************************
+ * Function: memoScan
+ * Description: list the entries of the cache directory. If maxBytes is not
+ * 		negative, the least recently used entries are removed until the
+ * 		total size is at most maxBytes. The mtime of an entry is its last use.
+ * Arguments: dir: char*, the cache directory
+ * 	      maxBytes: long, the size cap, or -1 to only count
+ * 	      count: int*, the number of entries left is stored here
+ * 	      bytes: long*, the total size left is stored here
+ * Postcondition: the evicted entries are unlinked and memoStats is updated.
+ * ****************************************************************************/
+void memoScan(const char *dir, long maxBytes, int *count, long *bytes)
+{
+	*count = 0;
+	*bytes = 0;
+	DIR *d = opendir(dir);
+	if (d == NULL)
+		return;
+	int capacity = 64, size = 0, i;
+	struct MemoEntry *entries = (struct MemoEntry*)malloc(capacity * sizeof(struct MemoEntry));
+	assert(entries);
+	struct dirent *de;
+	struct stat st;
+	while ((de = readdir(d)))
+	{
+		size_t len = strlen(de->d_name);
+		if (len < 5 || len >= sizeof(entries[0].name) || strcmp(de->d_name + len - 5, ".memo") != 0)
+			continue;
+		if (fstatat(dirfd(d), de->d_name, &st, 0) == -1)
+			continue;
+		if (size == capacity)
+		{
+			capacity *= 2;
+			entries = (struct MemoEntry*)realloc(entries, capacity * sizeof(struct MemoEntry));
+			assert(entries);
+		}
+		strcpy(entries[size].name, de->d_name);
+		entries[size].size = st.st_size;
+		entries[size].used = st.st_mtim;
+		*bytes += st.st_size;
+		size++;
+	}
+	*count = size;
+	if (maxBytes >= 0 && *bytes > maxBytes)
+	{
+		qsort(entries, size, sizeof(struct MemoEntry), compareMemoEntry);
+		for (i=0; i < size && *bytes > maxBytes; i++)
+		{
+			if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+			{
+				*bytes -= entries[i].size;
+				(*count)--;
+				memoStats.evictions++;
+			}
+		}
+	}
+	free(entries);
+	closedir(d);
+}
+
+/*******************************************************************************
+ * Function: memoReplay
+ * Description: copy the stored output of a cache entry to the file stdout of the
+ * 		command is redirected to, or to stdout if there is none, and read
+ * 		the exit method.
+ * Arguments: path: char*, the cache entry
+ * 	      output: a pointer to the struct Redirect of stdout, or NULL
+ * 	      exitMethod: int*, the stored exit method is written here
+ * Return value: 0 on success, -1 if the entry can't be used
+ * ****************************************************************************/
+int memoReplay(const char *path, struct Redirect *output, int *exitMethod)
+{
+	char buf[8192];
+	ssize_t n;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (read(fd, buf, MEMO_HEADER_SIZE) != MEMO_HEADER_SIZE
+		|| sscanf(buf, "smallsh-memo %d", exitMethod) != 1)
+	{
+		close(fd);
+		return -1;
+	}
+	int targetFD = STDOUT_FILENO;
+	if (output && (output->type == REDIR_OUT || output->type == REDIR_APPEND))
+	{
+		targetFD = open(output->target, O_WRONLY | O_CREAT | O_CLOEXEC
+			| (output->type == REDIR_APPEND ? O_APPEND : O_TRUNC), 0644);
+		if (targetFD == -1)
+		{
+			perror("memo output");
+			close(fd);
+			*exitMethod = 1 << 8;
+			return 0;
+		}
+	}
+	fflush(stdout);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+	{
+		ssize_t off = 0, w;
+		while (off < n && (w = write(targetFD, buf + off, n - off)) > 0)
+			off += w;
+		if (off < n)
+			break;
+	}
+	if (targetFD != STDOUT_FILENO)
+		close(targetFD);
+	close(fd);
+	return 0;
+}
+
+/*******************************************************************************
+ * Function: memoHandle
+ * Description: This is a built-in shell function. "memo [options] cmd args"
+ * 		runs cmd in the foreground and stores its stdout and exit status in
+ * 		the cache directory. Next time the same command is typed with the same
+ * 		inputs, the stored result is replayed without forking.
+ * 		The key is the hash of the expanded words, the working directory,
+ * 		PATH, the redirections, the input files and the declared
+ * 		dependencies.
+ * 		Options: -e VAR  also key on the environment variable VAR
+ * 			 -d FILE also key on the state of FILE
+ * 			 -c      hash the content of files instead of size/mtime/inode
+ * 			 -s      print the cache statistics
+ * 		The cache is capped at SMALLSH_MEMO_MAX bytes (64MB by default) by
+ * 		evicting the least recently used entries.
+ * Argument: c: a pointer to a struct CommandLine for the memo command
+ * 	     children: a pointer to the job table
+ * 	     deadline: long, the deadline of the command in ms, or -1 for none
+ * 	     lastFGExitMethod: int*, set to the exit method of the command
+ * 	     lastFGTimedOut: int*, set to 1 if the command was killed at its
+ * 	     		     deadline
+ * Precondition: c->arr[0] is "memo"
+ * Postcondition: the command is run or replayed. c loses its memo words.
+ * ****************************************************************************/
+void memoHandle(struct CommandLine *c, struct ChildrenPids *children, long deadline, int *lastFGExitMethod, int *lastFGTimedOut)
+{
+	char dir[1024], path[1100], tmpPath[1100];
+	int i = 1, content = 0, count;
+	long bytes;
+	unsigned long long key = 14695981039346656037ULL;
+
+	if (memoDir(dir, sizeof(dir)) == -1)
+	{
+		*lastFGExitMethod = 1 << 8;
+		return;
+	}
+	//the options are hashed first; the files are read after -c is known
+	for (i=1; i < c->size && c->arr[i][0] == '-'; i++)
+	{
+		if (strcmp(c->arr[i], "--") == 0)
+		{
+			i++;
+			break;
+		}
+		else if (strcmp(c->arr[i], "-c") == 0)
+			content = 1;
+		else if (strcmp(c->arr[i], "-s") == 0)
+		{
+			memoScan(dir, -1, &count, &bytes);
+			printf("memo: %d hits, %d misses, %d evictions, %d entries, %ld bytes\n",
+				memoStats.hits, memoStats.misses, memoStats.evictions, count, bytes);
+			fflush(stdout);
+			*lastFGExitMethod = 0;
+			return;
+		}
+		else if ((strcmp(c->arr[i], "-e") == 0 || strcmp(c->arr[i], "-d") == 0) && i+1 < c->size)
+			i++;
+		else
+			break;
+	}
+	int first = i, j;
+	if (first >= c->size)
+	{
+		fprintf(stderr, "usage: memo [-c] [-e VAR] [-d FILE] command [args]\n");
+		*lastFGExitMethod = 1 << 8;
+		return;
+	}
+	for (j=1; j < first; j++)
+	{
+		if (strcmp(c->arr[j], "-e") == 0)
+		{
+			char *value = envGet(c->arr[j+1]);
+			key = memoHash(key, c->arr[j+1], strlen(c->arr[j+1])+1);
+			if (value)
+				key = memoHash(key, value, strlen(value)+1);
+			j++;
+		}
+		else if (strcmp(c->arr[j], "-d") == 0)
+		{
+			key = memoHashFile(key, c->arr[j+1], content);
+			j++;
+		}
+	}
+	for (j=first; j < c->size; j++)
+		key = memoHash(key, c->arr[j], strlen(c->arr[j])+1);
+	if (getcwd(path, sizeof(path)))
+		key = memoHash(key, path, strlen(path)+1);
+	if (envGet("PATH"))
+		key = memoHash(key, envGet("PATH"), strlen(envGet("PATH"))+1);
+	for (j=0; j < c->numRedirs; j++)
+	{
+		struct Redirect *r = &c->redirs[j];
+		key = memoHash(key, &r->type, sizeof(r->type));
+		key = memoHash(key, &r->fd, sizeof(r->fd));
+		key = memoHash(key, &r->srcFD, sizeof(r->srcFD));
+		if (r->type == REDIR_IN)
+			key = memoHashFile(key, r->target, content);
+		else if (r->target)
+			key = memoHash(key, r->target, strlen(r->target)+1);
+	}
+	shiftCommandLine(c, first);
+
+	snprintf(path, sizeof(path), "%s/%016llx.memo", dir, key);
+	if (memoReplay(path, findRedirect(c, 1), lastFGExitMethod) == 0)
+	{
+		//mark the entry as recently used for the LRU eviction
+		utimensat(AT_FDCWD, path, NULL, 0);
+		memoStats.hits++;
+		reportFGExit(0, *lastFGExitMethod, 0);
+		return;
+	}
+	memoStats.misses++;
+
+	//the child writes its stdout after the header, which is filled in later
+	snprintf(tmpPath, sizeof(tmpPath), "%s/%016llx.tmp.%d", dir, key, getpid());
+	int fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1)
+	{
+		perror("memo");
+		*lastFGExitMethod = 1 << 8;
+		return;
+	}
+	char header[MEMO_HEADER_SIZE + 1];
+	snprintf(header, sizeof(header), "%-*s", MEMO_HEADER_SIZE - 1, "smallsh-memo");
+	header[MEMO_HEADER_SIZE - 1] = '\n';
+	write(fd, header, MEMO_HEADER_SIZE);
+
+	int childExitMethod = -5;
+	c->bg = 0;
+	pid_t spawnPid = spawnCommand(c, children, fd, deadline, 0)->pidNo;
+	*lastFGTimedOut = waitForeground(children, spawnPid, &childExitMethod);
+
+	//only normal exits are cached; a killed command may have partial output
+	snprintf(header, sizeof(header), "smallsh-memo %-*d", MEMO_HEADER_SIZE - 14, childExitMethod);
+	header[MEMO_HEADER_SIZE - 1] = '\n';
+	int stored = pwrite(fd, header, MEMO_HEADER_SIZE, 0) == MEMO_HEADER_SIZE
+		&& WIFEXITED(childExitMethod) && !*lastFGTimedOut && rename(tmpPath, path) == 0;
+	close(fd);
+	memoReplay(stored ? path : tmpPath, findRedirect(c, 1), lastFGExitMethod);
+	*lastFGExitMethod = childExitMethod;
+	if (stored)
+	{
+		char *env = envGet("SMALLSH_MEMO_MAX");
+		memoScan(dir, env ? atol(env) : MEMO_DEFAULT_MAX, &count, &bytes);
+	}
+	else
+		unlink(tmpPath);
+	reportFGExit(spawnPid, childExitMethod, *lastFGTimedOut);
+}
+
+#define TEE_PIPE_SIZE (1 << 20)  // the pipe size tee asks for, in bytes
+
+/*******************************************************************************
+ * Function: spliceAll
+ * Description: move len bytes from a pipe to a file descriptor. splice keeps
+ * 		the data in the kernel. If the destination doesn't take splice (a
+ * 		terminal, or a file opened with O_APPEND on older kernels) the bytes
+ * 		are copied through a buffer instead.
+ * Arguments: in: the pipe the bytes are taken from
+ * 	      out: the destination
+ * 	      len: size_t, the number of bytes to move; the pipe holds at least
+ * 	      	   that many
+ * Return value: 0 on success, -1 on error
+ * ****************************************************************************/
+int spliceAll(int in, int out, size_t len)
+{
+	char buf[8192];
+	ssize_t n;
+	while (len > 0)
+	{
+		n = splice(in, NULL, out, NULL, len, SPLICE_F_MORE);
+		if (n == -1 && errno == EINVAL)
+		{
+			n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+			ssize_t off = 0, w = 0;
+			while (off < n && (w = write(out, buf + off, n - off)) > 0)
+				off += w;
+			if (off < n)
+				return -1;
+		}
+		else if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * struct TeeTarget
+ * Description: a destination of the tee builtin
+ * Attributes: fd: the destination
+ * 	       ok: int, 0 once writing to the destination has failed
+ * 	       pipeFDs: int[2], the pipe the output is tee'd into before it is
+ * 	       		spliced to fd
+ * 	       name: char*, the name used in error messages
+ * ****************************************************************************/
+struct TeeTarget
+{
+	int fd;
+	int ok;
+	int pipeFDs[2];
+	const char *name;
+};
+
+/*******************************************************************************
+ * Function: teeHandle
+ * Description: This is a built-in shell function. "tee cmd args > f1 >> f2 ..."
+ * 		runs cmd in the foreground and writes its stdout to every stdout
+ * 		redirection and to the stdout of the shell, like "cmd | tee f1 f2"
+ * 		but without a tee process copying the bytes through user space.
+ * 		The output of cmd goes into a pipe. Each round tee(2) duplicates
+ * 		what is in the pipe into one pipe per destination without consuming
+ * 		it, splice moves it on to the destination, and then the same amount
+ * 		is dropped from the first pipe. The next round starts only when
+ * 		every destination has taken its copy, so a slow destination fills
+ * 		the pipe and blocks cmd instead of making the shell buffer it.
+ * 		A destination that fails is dropped and the others go on.
+ * Argument: c: a pointer to a struct CommandLine for the tee command
+ * 	     children: a pointer to the job table
+ * 	     deadline: long, the deadline of the command in ms, or -1 for none
+ * 	     lastFGExitMethod: int*, set to the exit method of the command, or to
+ * 	     		       exit value 1 if it succeeded but a destination failed
+ * 	     lastFGTimedOut: int*, set to 1 if the command was killed at its
+ * 	     		     deadline
+ * Precondition: c->arr[0] is "tee"
+ * Postcondition: the command is run. c loses its tee word and stdout
+ * 		  redirections.
+ * ****************************************************************************/
+void teeHandle(struct CommandLine *c, struct ChildrenPids *children, long deadline, int *lastFGExitMethod, int *lastFGTimedOut)
+{
+	int i, numTargets = 0, failed = 0;
+	if (c->size < 2)
+	{
+		fprintf(stderr, "usage: tee command [args] [> file] [>> file] ...\n");
+		*lastFGExitMethod = 1 << 8;
+		return;
+	}
+	shiftCommandLine(c, 1);
+
+	//the destinations are the stdout redirections in order, then the shell's stdout
+	struct TeeTarget *targets = (struct TeeTarget*)malloc((c->numRedirs + 1) * sizeof(struct TeeTarget));
+	assert(targets);
+	for (i=0; i < c->numRedirs; i++)
+	{
+		struct Redirect *r = &c->redirs[i];
+		int fd;
+		if (r->fd != 1 || r->type == REDIR_CLOSE)
+			continue;
+		if (r->type == REDIR_DUP)
+			fd = fcntl(r->srcFD, F_DUPFD_CLOEXEC, 3);
+		else
+			fd = open(r->target, O_WRONLY | O_CREAT | O_CLOEXEC
+				| (r->type == REDIR_APPEND ? O_APPEND : O_TRUNC), 0644);
+		if (fd == -1)
+		{
+			perror(r->target ? r->target : "tee");
+			failed = 1;
+			continue;
+		}
+		targets[numTargets].fd = fd;
+		targets[numTargets].ok = 1;
+		targets[numTargets++].name = r->target ? r->target : "tee";
+	}
+	targets[numTargets].fd = STDOUT_FILENO;
+	targets[numTargets].ok = 1;
+	targets[numTargets++].name = "stdout";
+	removeRedirects(c, 1);
+
+	int outPipe[2];
+	if (pipe2(outPipe, O_CLOEXEC) == -1)
+	{
+		perror("tee");
+		for (i=0; i < numTargets - 1; i++)
+			close(targets[i].fd);
+		free(targets);
+		*lastFGExitMethod = 1 << 8;
+		return;
+	}
+	//a bigger pipe means fewer rounds; the limit may refuse it, which is fine
+	fcntl(outPipe[0], F_SETPIPE_SZ, TEE_PIPE_SIZE);
+
+	int childExitMethod = -5;
+	c->bg = 0;
+	pid_t spawnPid = spawnCommand(c, children, outPipe[1], deadline, 0)->pidNo;
+	close(outPipe[1]);
+
+	int nullFD = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	int pipeSize = fcntl(outPipe[0], F_GETPIPE_SZ);
+	for (i=0; i < numTargets; i++)
+	{
+		if (pipe2(targets[i].pipeFDs, O_CLOEXEC) == -1)
+		{
+			perror("tee");
+			targets[i].pipeFDs[0] = targets[i].pipeFDs[1] = -1;
+			targets[i].ok = 0;
+			failed = 1;
+			continue;
+		}
+		fcntl(targets[i].pipeFDs[0], F_SETPIPE_SZ, pipeSize);
+	}
+
+	//a destination that goes away must fail with EPIPE, not kill the shell
+	struct sigaction ignore = {{0}}, oldSIGPIPE;
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, &oldSIGPIPE);
+	sigset_t toBlock;
+	sigemptyset(&toBlock);
+	sigaddset(&toBlock, SIGTSTP);
+	sigprocmask(SIG_BLOCK, &toBlock, NULL);
+
+	while (1)
+	{
+		//tee only copies what fits, so the round moves the least any pipe took
+		ssize_t n = -1, got;
+		int live = 0;
+		//wait for output here, where the deadlines can be enforced, not in tee
+		pollTimers(children, outPipe[0], NULL, -1);
+		for (i=0; i < numTargets; i++)
+		{
+			if (!targets[i].ok)
+				continue;
+			do
+				got = tee(outPipe[0], targets[i].pipeFDs[1], pipeSize, 0);
+			while (got == -1 && errno == EINTR);
+			if (got == -1)
+			{
+				perror(targets[i].name);
+				targets[i].ok = 0;
+				failed = 1;
+				continue;
+			}
+			if (n == -1 || got < n)
+				n = got;
+			live = 1;
+		}
+		if (!live)
+		{
+			//every destination failed; keep reading so the command isn't blocked
+			do
+				got = splice(outPipe[0], NULL, nullFD, NULL, pipeSize, 0);
+			while (got == -1 && errno == EINTR);
+			if (got <= 0)
+				break;
+			continue;
+		}
+		if (n == 0)
+			break;
+		for (i=0; i < numTargets; i++)
+		{
+			if (!targets[i].ok)
+				continue;
+			if (spliceAll(targets[i].pipeFDs[0], targets[i].fd, n) == -1)
+			{
+				perror(targets[i].name);
+				targets[i].ok = 0;
+				failed = 1;
+			}
+		}
+		//the bytes past n are sent again next round, so drop them from each copy
+		for (i=0; i < numTargets; i++)
+		{
+			int leftover = 0;
+			if (targets[i].pipeFDs[0] != -1 && ioctl(targets[i].pipeFDs[0], FIONREAD, &leftover) == 0 && leftover > 0)
+				spliceAll(targets[i].pipeFDs[0], nullFD, leftover);
+		}
+		spliceAll(outPipe[0], nullFD, n);
+	}
+	close(outPipe[0]);
+	close(nullFD);
+	sigprocmask(SIG_UNBLOCK, &toBlock, NULL);
+	sigaction(SIGPIPE, &oldSIGPIPE, NULL);
+
+	*lastFGTimedOut = waitForeground(children, spawnPid, &childExitMethod);
+
+	//the last target is the shell's own stdout, which stays open
+	for (i=0; i < numTargets; i++)
+	{
+		if (targets[i].pipeFDs[0] != -1)
+		{
+			close(targets[i].pipeFDs[0]);
+			close(targets[i].pipeFDs[1]);
+		}
+		if (i < numTargets - 1)
+			close(targets[i].fd);
+	}
+	free(targets);
+	*lastFGExitMethod = childExitMethod;
+	if (failed && WIFEXITED(childExitMethod) && WEXITSTATUS(childExitMethod) == 0)
+		*lastFGExitMethod = 1 << 8;
+	reportFGExit(spawnPid, childExitMethod, *lastFGTimedOut);
+}
+
+/*******************************************************************************
+ * struct Task
+ * Description: one line of a task file, "name : deps : command"
+ * Attributes: name: char*, the name of the task
+ * 	       deps: an array of dependency names, each a task or a file
+ * 	       depIdx: int*, the index of each dependency task, -1 for a file
+ * 	       numDeps: int, the number of dependencies
+ * 	       command: a pointer to the parsed struct CommandLine. The job table
+ * 	       		owns it once the task is started.
+ * 	       outputFile: char*, a copy of the output file of the command
+ * 	       state: int, one of the TASK_ values below
+ * 	       ran: int, 1 if the command was run, 0 if it was up to date
+ * 	       needed: int, 1 if the task is a requested target or one of its deps
+ * 	       pid: pid_t, the pid of the running command
+ * ****************************************************************************/
+struct Task
+{
+	char *name;
+	char **deps;
+	int *depIdx;
+	int numDeps;
+	struct CommandLine *command;
+	char *outputFile;
+	int state;
+	int ran;
+	int needed;
+	pid_t pid;
+};
+
+#define TASK_WAITING 0
+#define TASK_RUNNING 1
+#define TASK_DONE 2
+#define TASK_FAILED 3
+
+/*******************************************************************************
+ * Function: trimWord
+ * Description: remove the spaces and tabs at both ends of str in place
+ * Argument: str: char*
+ * Return value: a pointer to the first non blank char of str
+ * ****************************************************************************/
+char* trimWord(char *str)
+{
+	while (*str == ' ' || *str == '\t')
+		str++;
+	char *end = str + strlen(str);
+	while (end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n'))
+		*--end = '\0';
+	return str;
+}
+
+/*******************************************************************************
+ * Function: freeTasks
+ * Description: free the array of tasks. The commands that were handed to the
+ * 		job table are not freed here.
+ * Arguments: tasks: a pointer to an array of struct Task
+ * 	      numTasks: int, the number of tasks
+ * ****************************************************************************/
+void freeTasks(struct Task *tasks, int numTasks)
+{
+	int i, j;
+	for (i=0; i < numTasks; i++)
+	{
+		free(tasks[i].name);
+		for (j=0; j < tasks[i].numDeps; j++)
+			free(tasks[i].deps[j]);
+		free(tasks[i].deps);
+		free(tasks[i].depIdx);
+		free(tasks[i].outputFile);
+		if (tasks[i].command)
+		{
+			freeCommandLine(tasks[i].command);
+			memFree(MEM_PARSER, tasks[i].command);
+		}
+	}
+	free(tasks);
+}
+
+/*******************************************************************************
+ * Function: readTasks
+ * Description: read a task file. Each line is "name : dep dep ... : command".
+ * 		Blank lines and lines starting with # are skipped. The command is
+ * 		parsed with parseLine, so < > and $$ work as on the command line.
+ * Arguments: fileName: char*, the task file
+ * 	      numTasks: int*, the number of tasks read is stored here
+ * Return value: a dynamically allocated array of struct Task, or NULL on error
+ * ****************************************************************************/
+struct Task* readTasks(const char *fileName, int *numTasks)
+{
+	FILE *f = fopen(fileName, "re");
+	if (f == NULL)
+	{
+		perror("tasks");
+		return NULL;
+	}
+	int capacity = 16, lineNo = 0, i, j;
+	struct Task *tasks = (struct Task*)calloc(capacity, sizeof(struct Task));
+	assert(tasks);
+	*numTasks = 0;
+	char *line = NULL;
+	size_t bufferSize = 0;
+	while (getline(&line, &bufferSize, f) != -1)
+	{
+		lineNo++;
+		char *name = trimWord(line);
+		if (name[0] == '\0' || name[0] == '#')
+			continue;
+		char *deps = strchr(name, ':');
+		char *cmd = deps ? strchr(deps+1, ':') : NULL;
+		if (cmd == NULL)
+		{
+			fprintf(stderr, "tasks: %s:%d: expected name : deps : command\n", fileName, lineNo);
+			free(line);
+			fclose(f);
+			freeTasks(tasks, *numTasks);
+			return NULL;
+		}
+		*deps++ = '\0';
+		*cmd++ = '\0';
+		if (*numTasks == capacity)
+		{
+			tasks = (struct Task*)realloc(tasks, 2 * capacity * sizeof(struct Task));
+			assert(tasks);
+			memset(tasks + capacity, 0, capacity * sizeof(struct Task));
+			capacity *= 2;
+		}
+		struct Task *t = &tasks[(*numTasks)++];
+		name = trimWord(name);
+		t->name = (char*)calloc(strlen(name)+1, sizeof(char));
+		assert(t->name);
+		strcpy(t->name, name);
+
+		char *token, *rest = deps;
+		int depCapacity = 4;
+		t->deps = (char**)malloc(depCapacity * sizeof(char*));
+		assert(t->deps);
+		while ((token = strtok_r(rest, " \t", &rest)))
+		{
+			if (t->numDeps == depCapacity)
+			{
+				depCapacity *= 2;
+				t->deps = (char**)realloc(t->deps, depCapacity * sizeof(char*));
+				assert(t->deps);
+			}
+			t->deps[t->numDeps] = (char*)calloc(strlen(token)+1, sizeof(char));
+			assert(t->deps[t->numDeps]);
+			strcpy(t->deps[t->numDeps++], token);
+		}
+
+		t->command = parseLine(trimWord(cmd));
+		if (t->command->invalid)
+		{
+			fprintf(stderr, "tasks: %s:%d: syntax error in the command\n", fileName, lineNo);
+			free(line);
+			fclose(f);
+			freeTasks(tasks, *numTasks);
+			return NULL;
+		}
+		t->command->bg = 0;
+		struct Redirect *output = findRedirect(t->command, 1);
+		if (output && (output->type == REDIR_OUT || output->type == REDIR_APPEND))
+		{
+			t->outputFile = (char*)calloc(strlen(output->target)+1, sizeof(char));
+			assert(t->outputFile);
+			strcpy(t->outputFile, output->target);
+		}
+	}
+	free(line);
+	fclose(f);
+
+	//resolve the dependency names to tasks. Other names must be existing files.
+	for (i=0; i < *numTasks; i++)
+	{
+		struct Task *t = &tasks[i];
+		t->depIdx = (int*)malloc((t->numDeps + 1) * sizeof(int));
+		assert(t->depIdx);
+		for (j=0; j < t->numDeps; j++)
+		{
+			int k;
+			t->depIdx[j] = -1;
+			for (k=0; k < *numTasks; k++)
+				if (strcmp(tasks[k].name, t->deps[j]) == 0)
+					t->depIdx[j] = k;
+			if (t->depIdx[j] == -1 && access(t->deps[j], F_OK) == -1)
+			{
+				fprintf(stderr, "tasks: %s: unknown dependency %s\n", t->name, t->deps[j]);
+				freeTasks(tasks, *numTasks);
+				return NULL;
+			}
+		}
+	}
+	return tasks;
+}
+
+/*******************************************************************************
+ * Function: markNeeded
+ * Description: mark task i and every task it depends on as needed
+ * Arguments: tasks: a pointer to an array of struct Task
+ * 	      i: int, the index of the task
+ * ****************************************************************************/
+void markNeeded(struct Task *tasks, int i)
+{
+	int j;
+	if (tasks[i].needed)
+		return;
+	tasks[i].needed = 1;
+	for (j=0; j < tasks[i].numDeps; j++)
+		if (tasks[i].depIdx[j] != -1)
+			markNeeded(tasks, tasks[i].depIdx[j]);
+}
+
+/*******************************************************************************
+ * Function: taskUpToDate
+ * Description: a task is up to date if its command has an output file that is
+ * 		not older than its input files, its file dependencies and the output
+ * 		files of its dependency tasks, and none of those tasks was run now.
+ * Arguments: tasks: a pointer to an array of struct Task
+ * 	      t: a pointer to the task to check
+ * Return value: 1 if the task can be skipped, 0 otherwise
+ * ****************************************************************************/
+int taskUpToDate(struct Task *tasks, struct Task *t)
+{
+	struct stat out, in;
+	int j;
+	if (t->outputFile == NULL || stat(t->outputFile, &out) == -1)
+		return 0;
+	for (j=0; j < t->numDeps + t->command->numRedirs; j++)
+	{
+		const char *path;
+		if (j >= t->numDeps)
+		{
+			struct Redirect *r = &t->command->redirs[j - t->numDeps];
+			path = r->type == REDIR_IN ? r->target : NULL;
+		}
+		else if (t->depIdx[j] == -1)
+			path = t->deps[j];
+		else if (tasks[t->depIdx[j]].ran || tasks[t->depIdx[j]].outputFile == NULL)
+			return 0;
+		else
+			path = tasks[t->depIdx[j]].outputFile;
+		if (path == NULL)
+			continue;
+		if (stat(path, &in) == -1)
+			return 0;
+		if (in.st_mtim.tv_sec > out.st_mtim.tv_sec ||
+			(in.st_mtim.tv_sec == out.st_mtim.tv_sec && in.st_mtim.tv_nsec > out.st_mtim.tv_nsec))
+			return 0;
+	}
+	return 1;
+}
+
+/*******************************************************************************
+ * Function: catchSIGCHLD
+ * Description: the SIGCHLD handler used while tasks runs. It does nothing; being
+ * 		caught is what ends the wait in pollTimers, after which the tasks
+ * 		are checked with waitpid.
+ * Argument: signo: int, the signal number
+ * ****************************************************************************/
+void catchSIGCHLD(int signo)
+{
+}
+
+/*******************************************************************************
+ * Function: tasksHandle
+ * Description: This is a built-in shell function. "tasks [-j N] [-B] file
+ * 		[target...]" reads a task file and runs the tasks in dependency
+ * 		order. Every task whose dependencies are done is started right away,
+ * 		up to N at a time (the number of CPUs by default), so the longest
+ * 		chain of dependencies bounds the wall time. The running tasks are
+ * 		kept in the job table and the shell sleeps until a SIGCHLD says
+ * 		one of them has finished or a deadline fires. A deadline given
+ * 		with timeout is for the whole run: each task is started with
+ * 		whatever is left of it. A task whose output file is newer than
+ * 		its inputs is skipped unless -B is given. After a failure no new
+ * 		task is started.
+ * Arguments: c: a pointer to a struct CommandLine for the tasks command
+ * 	      children: a pointer to the job table
+ * 	      maxChildren: int, the size limit of the job table
+ * 	      deadline: long, the deadline of the whole run in ms, or -1 for none
+ * 	      lastFGExitMethod: int*, set to the exit method of the failed task,
+ * 	      		or 0 if all tasks succeeded
+ * Precondition: c->arr[0] is "tasks"
+ * Postcondition: the needed tasks are run or skipped, and none is left running.
+ * ****************************************************************************/
+void tasksHandle(struct CommandLine *c, struct ChildrenPids *children, int maxChildren, long deadline, int *lastFGExitMethod)
+{
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN), force = 0, i, j;
+	for (i=1; i < c->size && c->arr[i][0] == '-'; i++)
+	{
+		if (strcmp(c->arr[i], "-j") == 0 && i+1 < c->size)
+			jobs = atoi(c->arr[++i]);
+		else if (strncmp(c->arr[i], "-j", 2) == 0 && c->arr[i][2] != '\0')
+			jobs = atoi(c->arr[i] + 2);
+		else if (strcmp(c->arr[i], "-B") == 0)
+			force = 1;
+		else
+			break;
+	}
+	*lastFGExitMethod = 1 << 8;
+	if (i >= c->size || jobs < 1)
+	{
+		fprintf(stderr, "usage: tasks [-j N] [-B] file [target...]\n");
+		return;
+	}
+	//leave room in the job table for the background processes
+	if (jobs > maxChildren - 1 - children->size)
+		jobs = maxChildren - 1 - children->size;
+	if (jobs < 1)
 	{
-		if(strcmp("&", commands->arr[commands->size - 1]) == 0)
+		fprintf(stderr, "tasks: too many background processes\n");
+		return;
+	}
+
+	int numTasks = 0;
+	struct Task *tasks = readTasks(c->arr[i], &numTasks);
+	if (tasks == NULL)
+		return;
+	if (i+1 == c->size)
+		for (j=0; j < numTasks; j++)
+			markNeeded(tasks, j);
+	for (i=i+1; i < c->size; i++)
+	{
+		for (j=0; j < numTasks && strcmp(tasks[j].name, c->arr[i]) != 0; j++)
+			;
+		if (j == numTasks)
 		{
-			commands->bg = 1;
-			free(commands->arr[commands->size-1]);
-			commands->arr[commands->size-1] = NULL;
-			commands->size--;
-			// if no input or output is provided, then set them to /dev/null
-			if (commands->inputFile == NULL)
+			fprintf(stderr, "tasks: no task named %s\n", c->arr[i]);
+			freeTasks(tasks, numTasks);
+			return;
+		}
+		markNeeded(tasks, j);
+	}
+
+	//SIGCHLD is blocked except while waiting in pollTimers, so no exit is missed
+	struct sigaction chldAction = {{0}}, oldChldAction;
+	chldAction.sa_handler = catchSIGCHLD;
+	sigaction(SIGCHLD, &chldAction, &oldChldAction);
+	sigset_t toBlock, waitMask;
+	sigemptyset(&toBlock);
+	sigaddset(&toBlock, SIGCHLD);
+	sigaddset(&toBlock, SIGTSTP);
+	sigprocmask(SIG_BLOCK, &toBlock, &waitMask);
+	sigdelset(&waitMask, SIGCHLD);
+
+	int running = 0, failed = 0, progress = 1;
+	*lastFGExitMethod = 0;
+	while (progress || running > 0)
+	{
+		progress = 0;
+		//start the tasks whose dependencies are all done
+		for (i=0; i < numTasks && !failed && running < jobs; i++)
+		{
+			struct Task *t = &tasks[i];
+			if (!t->needed || t->state != TASK_WAITING)
+				continue;
+			for (j=0; j < t->numDeps; j++)
+				if (t->depIdx[j] != -1 && tasks[t->depIdx[j]].state != TASK_DONE)
+					break;
+			if (j < t->numDeps)
+				continue;
+			progress = 1;
+			if (!force && taskUpToDate(tasks, t))
+			{
+				printf("Task %s is up to date\n", t->name);
+				fflush(stdout);
+				t->state = TASK_DONE;
+				continue;
+			}
+			if (t->command->size == 0)
 			{
-				commands->inputFile = (char*)calloc(10, sizeof(char));
-				assert(commands->inputFile);
-				strcpy(commands->inputFile, "/dev/null");
+				t->state = TASK_DONE;
+				continue;
 			}
-			if (commands->outputFile == NULL)
+			long left = -1;
+			if (deadline >= 0)
 			{
-				commands->outputFile = (char*)calloc(10, sizeof(char));
-				assert(commands->outputFile);
-				strcpy(commands->outputFile, "/dev/null");
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				left = deadline - (now.tv_sec - start.tv_sec) * 1000 - (now.tv_nsec - start.tv_nsec) / 1000000;
+				if (left < 0)
+					left = 0;
 			}
+			t->pid = spawnCommand(t->command, children, -1, left, 1)->pidNo;
+			printf("Task %s starts (pid %d)\n", t->name, t->pid);
+			fflush(stdout);
+			t->command = NULL;
+			t->state = TASK_RUNNING;
+			t->ran = 1;
+			running++;
+		}
+		if (running == 0)
+			continue;
 
+		pollTimers(children, -1, &waitMask, -1);
+		for (i=0; i < numTasks; i++)
+		{
+			struct Task *t = &tasks[i];
+			int childExitMethod;
+			if (t->state != TASK_RUNNING || waitpid(t->pid, &childExitMethod, WNOHANG) <= 0)
+				continue;
+			deleteChildrenPids(children, t->pid);
+			running--;
+			progress = 1;
+			if (WIFEXITED(childExitMethod) && WEXITSTATUS(childExitMethod) == 0)
+			{
+				t->state = TASK_DONE;
+				continue;
+			}
+			t->state = TASK_FAILED;
+			failed = 1;
+			*lastFGExitMethod = childExitMethod;
+			printf("Task %s failed: ", t->name);
+			if (WIFEXITED(childExitMethod))
+				printf("exit value %d\n", WEXITSTATUS(childExitMethod));
+			else
+				printf("terminated by signal %d\n", WTERMSIG(childExitMethod));
+			fflush(stdout);
 		}
 	}
-	return commands;
+
+	sigprocmask(SIG_SETMASK, &waitMask, NULL);
+	sigprocmask(SIG_UNBLOCK, &toBlock, NULL);
+	sigaction(SIGCHLD, &oldChldAction, NULL);
+
+	if (!failed)
+	{
+		for (i=0; i < numTasks; i++)
+			if (tasks[i].needed && tasks[i].state == TASK_WAITING)
+			{
+				fprintf(stderr, "tasks: dependency cycle at %s\n", tasks[i].name);
+				*lastFGExitMethod = 1 << 8;
+				break;
+			}
+	}
+	freeTasks(tasks, numTasks);
 }
 
 
+// The /proc files sampled by jobs -m, in the order of procFD in struct Link
+const char *PROC_FILES[3] = {"stat", "statm", "io"};
 
-/*******************************************************************
- * Function: cdHandle
- * Description: built-in shell function. If the user type in cd,
- * 		then this function is invoked. If the user typed 
- * 		in the directory, then the current working directory
- * 		is changed to it. Otherwise, the directory is changed
- * 		to the environment variable HOME. The exit value is 0
- * 		if the directory is successfully changed. Otherwise
- * 		the exit value is 1.
- * Argument: c: a pointer to a struct CommandLine that has the info
- * 		for cd command.
- * Precondition: N/A
- * Postcondition: the current working directory is changed to either
- * 		  the one specified by the user, or HOME.
- * ******************************************************************/
-void cdHandle(struct CommandLine *c)
+/*******************************************************************************
+ * Function: readProcFile
+ * Description: read /proc/<pid>/<file> into buf. The file is opened the first
+ * 		time and kept open in the struct Link, so that later samples only
+ * 		cost one pread.
+ * Arguments: l: a pointer to the struct Link of the process
+ * 	      which: int, the index of the file in PROC_FILES
+ * 	      buf: char*, the buffer to read into
+ * 	      size: size_t, the size of buf
+ * Return value: the number of bytes read, or -1 if the file can't be read
+ * ****************************************************************************/
+ssize_t readProcFile(struct Link *l, int which, char *buf, size_t size)
 {
-	int result;
-	char path[1024];
-	memset(path, '\0', 1024);
-	if (c->size == 1)   //If there is only one command cd
-	{	//get $HOME
-		sprintf(path, "%s", getenv("HOME"));
+	if (l->procFD[which] == -1)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/%d/%s", l->pidNo, PROC_FILES[which]);
+		l->procFD[which] = open(path, O_RDONLY | O_CLOEXEC);
+		if (l->procFD[which] == -1)
+			return -1;
 	}
-	else if (c->size >= 2)
+	ssize_t n = pread(l->procFD[which], buf, size - 1, 0);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return n;
+}
+
+/*******************************************************************************
+ * Function: sampleJob
+ * Description: read the cpu time, resident memory and io counters of a process
+ * Arguments: l: a pointer to the struct Link of the process
+ * 	      buf: char*, a buffer of at least 4096 chars used for parsing
+ * 	      ticks: the utime + stime in clock ticks is stored here
+ * 	      rss: the resident memory in KB is stored here
+ * 	      rchar, wchar: the bytes read and written are stored here
+ * Return value: 0 on success, -1 if the process can't be sampled
+ * ****************************************************************************/
+int sampleJob(struct Link *l, char *buf, unsigned long long *ticks, long *rss,
+	unsigned long long *rchar, unsigned long long *wchar)
+{
+	unsigned long long utime, stime;
+	long pages;
+	//the command name in stat may have spaces, so parse after the last ')'
+	char *p;
+	if (readProcFile(l, 0, buf, 4096) == -1 || (p = strrchr(buf, ')')) == NULL
+		|| sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+		return -1;
+	*ticks = utime + stime;
+	*rss = 0;
+	if (readProcFile(l, 1, buf, 4096) != -1 && sscanf(buf, "%*d %ld", &pages) == 1)
+		*rss = pages * (sysconf(_SC_PAGESIZE) / 1024);
+	*rchar = *wchar = 0;
+	if (readProcFile(l, 2, buf, 4096) != -1)
 	{
-		strcpy(path, c->arr[1]);
+		if ((p = strstr(buf, "rchar:")))
+			sscanf(p, "rchar: %llu", rchar);
+		if ((p = strstr(buf, "wchar:")))
+			sscanf(p, "wchar: %llu", wchar);
 	}
-	
+	return 0;
+}
 
-	result = chdir(path);
-	if (result == -1)
+/*******************************************************************************
+ * Function: jobsHandle
+ * Description: This is a built-in shell function. "jobs" lists the pid and the
+ * 		command of every process the shell is tracking. "jobs -m [interval]"
+ * 		shows a monitor that is refreshed every interval seconds (1 by
+ * 		default) with the CPU%, resident memory and bytes read and written
+ * 		of each process, sampled from /proc. On a terminal it runs until
+ * 		Enter is pressed; otherwise one sample is printed.
+ * Arguments: c: a pointer to a struct CommandLine for the jobs command
+ * 	      children: a pointer to the job table
+ * Precondition: c->arr[0] is "jobs"
+ * Postcondition: the jobs are printed to the terminal.
+ * ****************************************************************************/
+void jobsHandle(struct CommandLine *c, struct ChildrenPids *children)
+{
+	struct Link *temp;
+	int j;
+	if (c->size < 2 || strcmp(c->arr[1], "-m") != 0)
 	{
-		perror("cd error");
+		for (temp = children->list; temp; temp = temp->next)
+		{
+			printf("%d", temp->pidNo);
+			for (j=0; j < temp->command->size; j++)
+				printf(" %s", temp->command->arr[j]);
+			printf("\n");
+		}
+		fflush(stdout);
+		return;
+	}
+	long interval = c->size > 2 ? parseDuration(c->arr[2]) : 1000;
+	if (interval <= 0)
+	{
+		fprintf(stderr, "usage: jobs [-m [interval]]\n");
+		return;
 	}
 
+	char buf[4096];
+	unsigned long long ticks, rchar, wchar;
+	long rss;
+	double hz = sysconf(_SC_CLK_TCK);
+	int tty = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+	struct timespec last, now;
+	//the first sample only sets cpuTicks so that the CPU% covers one interval
+	for (temp = children->list; temp; temp = temp->next)
+		if (sampleJob(temp, buf, &ticks, &rss, &rchar, &wchar) == 0)
+			temp->cpuTicks = ticks;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while (1)
+	{
+		//the deadlines of the jobs are still enforced while the monitor waits
+		int done = pollTimers(children, tty ? STDIN_FILENO : -1, NULL, interval) || !tty;
+		if (done && tty)
+		{
+			//consume the key press so it is not read as a command
+			char *rest = NULL;
+			size_t restSize = 0;
+			getline(&rest, &restSize, stdin);
+			free(rest);
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) / 1e9;
+		last = now;
+
+		if (tty)
+			printf("\033[H\033[J");
+		printf("%7s %6s %10s %12s %12s  %s\n", "PID", "CPU%", "RSS(KB)", "READ", "WRITE", "COMMAND");
+		for (temp = children->list; temp; temp = temp->next)
+		{
+			if (sampleJob(temp, buf, &ticks, &rss, &rchar, &wchar) == -1)
+				continue;
+			double cpu = elapsed > 0 ? 100.0 * (ticks - temp->cpuTicks) / hz / elapsed : 0;
+			temp->cpuTicks = ticks;
+			printf("%7d %6.1f %10ld %12llu %12llu  %s\n", temp->pidNo, cpu, rss,
+				rchar, wchar, temp->command->size ? temp->command->arr[0] : "");
+		}
+		if (tty)
+			printf("(press Enter to stop)\n");
+		fflush(stdout);
+		if (done)
+			break;
+	}
 }
 
 /*******************************************************************************
- * Function: exitHandle
- * Description: This is a built-in shell function. When the user typed in exit,
- * 		then this function is invoked. It kills all the processes or jobs the 
- * 		shell has not finished.
- * Argument: children, a pointer to a struct ChildrenPids that stores all the
- * 	     pids of the children process that are still running.
- * Precondition: N/A
- * Postcondition: all the children processes are killed.
+ * Function: currentRSS
+ * Description: read the resident memory of the shell from /proc/self/statm
+ * Return value: the resident memory in KB, or -1 if it can't be read
  * ****************************************************************************/
-void exitHandle(struct ChildrenPids *children)
-{	
-	struct Link* temp;
-	int result;
-	int i=0;
-	while (children->size != 0 && i < 50)
+long currentRSS()
+{
+	long pages = -1;
+	FILE *f = fopen("/proc/self/statm", "re");
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%*d %ld", &pages) != 1)
+		pages = -1;
+	fclose(f);
+	return pages == -1 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*******************************************************************************
+ * Function: liveAllocs
+ * Description: add up the live allocations of all the subsystems
+ * Return value: the number of live allocations
+ * ****************************************************************************/
+long liveAllocs()
+{
+	long total = 0;
+	int i;
+	for (i=0; i < MEM_SUBSYSTEMS; i++)
+		total += memStats[i].allocs;
+	return total;
+}
+
+/*******************************************************************************
+ * struct Shell
+ * Description: the state the shell loop keeps from one command line to the next
+ * Attributes: children: the job table
+ * 	       lastFGExitMethod: int, the exit method of the last foreground process
+ * 	       lastFGTimedOut: int, 1 if it was killed at its deadline
+ * 	       keepGoing: int, 0 once the shell should exit
+ * ****************************************************************************/
+struct Shell
+{
+	struct ChildrenPids children;
+	int lastFGExitMethod;
+	int lastFGTimedOut;
+	int keepGoing;
+};
+
+// runLine runs the soak test's lines and is defined after the built-in functions
+void runLine(struct Shell *sh, struct CommandLine *commands, char *line);
+
+// The command lines fed to the shell loop by memstats -soak. They cover the
+// built-in functions, assignments, here-documents and $$ expansion, and none
+// of them forks once the memo entry exists.
+const char *SOAK_LINES[] = {
+	"cd /tmp",
+	"status",
+	"# a comment <<EOF",
+	"SOAK_A=$$ SOAK_B=x status",
+	"export SOAK_C=$$$$",
+	"unset SOAK_C",
+	"status <<END",
+	"body $$",
+	"END",
+	"status <<< here$$",
+	"timeout 5 cd .",
+	"jobs",
+	"memstats",
+	"memo -e HOME cat < /etc/passwd",
+	"export",
+	"",
+	"cd",
+};
+
+// The command lines that start processes, fed every SOAK_SPAWN_EVERY lines
+const char *SOAK_SPAWN_LINES[] = {
+	"ls -la /tmp > /dev/null",
+	"true &",
+	"wc -l < /etc/passwd > /dev/null &",
+	"timeout 5 true",
+	"SOAK_A=1 env > /dev/null",
+	"cat <<EOF > /dev/null",
+	"spawn $$",
+	"EOF",
+	"cat <<< $$ > /dev/null",
+	"tee echo $$ > /dev/null",
+	"a b c d e f g h i j k l m n o p q r s t u v w x y z",
+};
+#define SOAK_SPAWN_EVERY 10000
+
+/*******************************************************************************
+ * Function: soakStream
+ * Description: write command lines to an unlinked temporary file that the soak
+ * 		test reads them from, the way the shell reads stdin
+ * Arguments: lines: an array of lines
+ * 	      numLines: int, the number of lines
+ * 	      extra: char*, one more line, or NULL
+ * Return value: the file, positioned at the start, or NULL on error
+ * ****************************************************************************/
+FILE* soakStream(const char **lines, int numLines, const char *extra)
+{
+	int i;
+	FILE *f = tmpfile();
+	if (f == NULL)
+		return NULL;
+	for (i=0; i < numLines; i++)
+		fprintf(f, "%s\n", lines[i]);
+	if (extra)
+		fprintf(f, "%s\n", extra);
+	rewind(f);
+	return f;
+}
+
+/*******************************************************************************
+ * Function: soakLine
+ * Description: read the next command line of a soak stream, starting over at
+ * 		its end, and run it exactly as main does with a line from stdin
+ * Arguments: sh: a pointer to the struct Shell
+ * 	      in: the soak stream
+ * ****************************************************************************/
+void soakLine(struct Shell *sh, FILE *in)
+{
+	char *line = NULL;
+	size_t bufferSize = 0;
+	ssize_t n = getline(&line, &bufferSize, in);
+	if (n == -1)
 	{
-		temp = children->list;
-		result = kill(temp->pidNo, SIGTERM);
-		if (result == 0)
+		rewind(in);
+		n = getline(&line, &bufferSize, in);
+	}
+	memTrack(MEM_INPUT, line);
+	if (n > 0 && line[n-1] == '\n')
+		line[n-1] = '\0';
+	struct CommandLine *commands = parseLine(line);
+	if (!isComment(commands))
+		readHereDocs(commands, in);
+	runLine(sh, commands, line);
+}
+
+/*******************************************************************************
+ * Function: soakSettle
+ * Description: wait until the background processes started by the soak test
+ * 		have finished and been removed from the job table, so that the
+ * 		allocations are counted at the same point every time
+ * Arguments: sh: a pointer to the struct Shell
+ * 	      before: pid_t*, the jobs that were running before the test
+ * 	      numBefore: int, the number of them
+ * ****************************************************************************/
+void soakSettle(struct Shell *sh, pid_t *before, int numBefore)
+{
+	while (1)
+	{
+		struct Link *temp;
+		int i, busy = 0;
+		for (temp = sh->children.list; temp && !busy; temp = temp->next)
+		{
+			for (i=0; i < numBefore && before[i] != temp->pidNo; i++)
+				;
+			busy = i == numBefore;
+		}
+		if (!busy)
+			return;
+		checkBGChildren(&sh->children);
+		poll(NULL, 0, 1);
+	}
+}
+
+/*******************************************************************************
+ * Function: memSoak
+ * Description: feed n command lines through runLine, the same code the shell
+ * 		loop runs, with their here-documents read from the stream like
+ * 		stdin. Every SOAK_SPAWN_EVERY lines the lines that start foreground,
+ * 		background, tee and tasks processes are fed too. The output of the
+ * 		commands goes to /dev/null. After a tenth of the lines the live
+ * 		allocations and RSS are recorded; at the end they must be no
+ * 		higher. The working directory is put back afterwards.
+ * Arguments: n: long, the number of command lines
+ * 	      sh: a pointer to the struct Shell
+ * Return value: 1 if the allocations and RSS stayed flat, 0 otherwise
+ * ****************************************************************************/
+int memSoak(long n, struct Shell *sh)
+{
+	const int numSpawnLines = sizeof(SOAK_SPAWN_LINES) / sizeof(SOAK_SPAWN_LINES[0]);
+	long i, warmup = n / 10, allocsBefore = 0, rssBefore = 0;
+	int j, numBefore = 0;
+	char cwd[4096], tasksLine[64];
+	struct Link *temp;
+
+	//the tasks file is an unlinked file the tasks builtin opens through /proc
+	FILE *tasks = tmpfile();
+	if (tasks == NULL || getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		perror("memstats");
+		if (tasks)
+			fclose(tasks);
+		return 0;
+	}
+	fprintf(tasks, "a : : true\nb : a : true $$\n");
+	fflush(tasks);
+	snprintf(tasksLine, sizeof(tasksLine), "tasks -B /proc/self/fd/%d", fileno(tasks));
+	FILE *lines = soakStream(SOAK_LINES, sizeof(SOAK_LINES) / sizeof(SOAK_LINES[0]), NULL);
+	FILE *spawnLines = soakStream(SOAK_SPAWN_LINES, numSpawnLines, tasksLine);
+	pid_t *before = (pid_t*)memAlloc(MEM_JOBS, (sh->children.size + 1) * sizeof(pid_t));
+	assert(before);
+	for (temp = sh->children.list; temp; temp = temp->next)
+		before[numBefore++] = temp->pidNo;
+
+	fflush(stdout);
+	int savedOut = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+	int savedErr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+	int nullFD = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (lines == NULL || spawnLines == NULL || savedOut == -1 || savedErr == -1 || nullFD == -1)
+	{
+		perror("memstats");
+		n = 0;
+	}
+	else
+	{
+		dup2(nullFD, STDOUT_FILENO);
+		dup2(nullFD, STDERR_FILENO);
+	}
+
+	for (i=0; i < n; i++)
+	{
+		if (i == warmup)
+		{
+			soakSettle(sh, before, numBefore);
+			allocsBefore = liveAllocs();
+			rssBefore = currentRSS();
+		}
+		soakLine(sh, lines);
+		if (i % SOAK_SPAWN_EVERY == 0)
+			//the stream has the tasks line too, and its two here-document lines are
+			//read with their command
+			for (j=0; j < numSpawnLines - 1; j++)
+				soakLine(sh, spawnLines);
+	}
+	soakSettle(sh, before, numBefore);
+	long allocsAfter = liveAllocs(), rssAfter = currentRSS();
+
+	fflush(stdout);
+	if (savedOut != -1)
+	{
+		dup2(savedOut, STDOUT_FILENO);
+		close(savedOut);
+	}
+	if (savedErr != -1)
+	{
+		dup2(savedErr, STDERR_FILENO);
+		close(savedErr);
+	}
+	if (nullFD != -1)
+		close(nullFD);
+	if (lines)
+		fclose(lines);
+	if (spawnLines)
+		fclose(spawnLines);
+	fclose(tasks);
+	memFree(MEM_JOBS, before);
+	if (chdir(cwd) == 0)
+		envSet("PWD", 3, cwd);
+	if (n == 0)
+		return 0;
+
+	//allow a little RSS noise from the allocator, but no steady growth
+	int pass = allocsAfter <= allocsBefore && rssAfter - rssBefore <= 512;
+	printf("soak: %ld commands, live allocations %ld -> %ld, RSS %ldKB -> %ldKB: %s\n",
+		n, allocsBefore, allocsAfter, rssBefore, rssAfter, pass ? "PASS" : "FAIL");
+	fflush(stdout);
+	return pass;
+}
+
+/*******************************************************************************
+ * Function: memstatsHandle
+ * Description: This is a built-in shell function. "memstats" prints the live
+ * 		allocations and bytes, the peak bytes and the total allocations of
+ * 		each subsystem, and the RSS of the shell. "memstats -soak N" runs
+ * 		the soak test memSoak with N command lines.
+ * Arguments: c: a pointer to a struct CommandLine for the memstats command
+ * 	      sh: a pointer to the struct Shell; its lastFGExitMethod is set to
+ * 	      	  1 if the soak test fails, 0 otherwise
+ * Precondition: c->arr[0] is "memstats"
+ * Postcondition: the statistics are printed to the terminal.
+ * ****************************************************************************/
+void memstatsHandle(struct CommandLine *c, struct Shell *sh)
+{
+	int i;
+	if (c->size >= 2 && strcmp(c->arr[1], "-soak") == 0)
+	{
+		long n = c->size > 2 ? atol(c->arr[2]) : 1000000;
+		sh->lastFGExitMethod = n < 1 || memSoak(n, sh) == 0 ? 1 << 8 : 0;
+		return;
+	}
+	sh->lastFGExitMethod = 0;
+	printf("%-10s %10s %12s %12s %12s\n", "subsystem", "allocs", "bytes", "peak", "total");
+	for (i=0; i < MEM_SUBSYSTEMS; i++)
+		printf("%-10s %10ld %12ld %12ld %12ld\n", MEM_NAMES[i], memStats[i].allocs,
+			memStats[i].bytes, memStats[i].peakBytes, memStats[i].totalAllocs);
+	printf("rss %ldKB\n", currentRSS());
+	fflush(stdout);
+}
+
+/*******************************************************************************
+ * Precompiled scripts
+ * A script run with "smallsh script" is parsed once with deferExpansion set,
+ * and the resulting command lines are written to a cache file keyed by the
+ * script's path, size and mtime. Later runs mmap the cache file and build
+ * the command lines from it without reading the script, expanding "$$" as
+ * they go. The format is a struct ScriptHeader, the script path, then one
+ * record per command:
+ * 	uint32 record length, uint32 number of words, uint32 number of
+ * 	redirections, uint32 bg
+ * 	each word: uint32 length (SCRIPT_HAS_PID set if it has "$$"), the chars
+ * 	each redirection: int32 type, fd, srcFD, uint32 length as for a word
+ * 		(SCRIPT_NO_TARGET if there is none), the chars
+ * Every string is null terminated and padded to a multiple of 4 bytes.
+ * ****************************************************************************/
+#define SCRIPT_MAGIC "SSC1"
+#define SCRIPT_HAS_PID 0x80000000U
+#define SCRIPT_NO_TARGET 0xFFFFFFFFU
+
+/*******************************************************************************
+ * struct ScriptHeader
+ * Description: the start of a cache file. A cache file is used only if its
+ * 		header matches the script as it is now.
+ * Attributes: magic: SCRIPT_MAGIC
+ * 	       pathLen: uint32_t, the length of the absolute path of the script
+ * 	       dev, ino: the device and inode of the script
+ * 	       size: the size of the script in bytes
+ * 	       mtimeSec, mtimeNsec: the mtime of the script
+ * 	       numCommands: the number of records after the path
+ * ****************************************************************************/
+struct ScriptHeader
+{
+	char magic[4];
+	uint32_t pathLen;
+	uint64_t dev;
+	uint64_t ino;
+	int64_t size;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	uint64_t numCommands;
+};
+
+/*******************************************************************************
+ * struct Script
+ * Description: a compiled script being run
+ * Attributes: data: the compiled commands, mmap'd from the cache or in memory
+ * 	       size: size_t, the size of data
+ * 	       off: size_t, the offset of the next record
+ * 	       mapped: int, 1 if data is mmap'd, 0 if it is malloc'd
+ * ****************************************************************************/
+struct Script
+{
+	char *data;
+	size_t size;
+	size_t off;
+	int mapped;
+};
+
+/*******************************************************************************
+ * struct ByteBuffer
+ * Description: a growing buffer the compiled script is written to
+ * ****************************************************************************/
+struct ByteBuffer
+{
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+/*******************************************************************************
+ * Function: appendBytes
+ * Description: append bytes to a struct ByteBuffer, doubling its capacity as
+ * 		needed
+ * Arguments: b: a pointer to the struct ByteBuffer
+ * 	      bytes: the bytes to append
+ * 	      len: size_t, the number of bytes
+ * ****************************************************************************/
+void appendBytes(struct ByteBuffer *b, const void *bytes, size_t len)
+{
+	if (b->size + len > b->capacity)
+	{
+		while (b->size + len > b->capacity)
+			b->capacity = b->capacity ? 2 * b->capacity : 4096;
+		b->data = (char*)realloc(b->data, b->capacity);
+		assert(b->data);
+	}
+	memcpy(b->data + b->size, bytes, len);
+	b->size += len;
+}
+
+/*******************************************************************************
+ * Function: appendUint32
+ * Description: append a uint32_t to a struct ByteBuffer in host byte order; the
+ * 		cache file is only read on the machine that wrote it
+ * Arguments: b: a pointer to the struct ByteBuffer
+ * 	      value: uint32_t, the value
+ * ****************************************************************************/
+void appendUint32(struct ByteBuffer *b, uint32_t value)
+{
+	appendBytes(b, &value, sizeof(value));
+}
+
+/*******************************************************************************
+ * Function: appendString
+ * Description: append the length, the chars, the null char and the padding
+ * 		of a string. The length has SCRIPT_HAS_PID set if the string has
+ * 		"$$", so the loader knows what to expand without searching.
+ * ****************************************************************************/
+void appendString(struct ByteBuffer *b, const char *str)
+{
+	static const char zeros[4] = {0, 0, 0, 0};
+	if (str == NULL)
+	{
+		appendUint32(b, SCRIPT_NO_TARGET);
+		return;
+	}
+	uint32_t len = strlen(str);
+	appendUint32(b, len | (strstr(str, "$$") ? SCRIPT_HAS_PID : 0));
+	appendBytes(b, str, len);
+	appendBytes(b, zeros, 4 - len % 4);
+}
+
+/*******************************************************************************
+ * Function: scriptCachePath
+ * Description: find the cache file of a script. It is in SMALLSH_SCRIPT_CACHE if
+ * 		set, otherwise $HOME/.smallsh_cache, and named after a hash of the
+ * 		absolute path of the script. The directory is created if needed.
+ * Arguments: script: char*, the absolute path of the script
+ * 	      path: char*, the buffer the cache file name is written to
+ * 	      size: size_t, the size of the buffer
+ * Return value: 0 on success, -1 if the cache directory can't be used
+ * ****************************************************************************/
+int scriptCachePath(const char *script, char *path, size_t size)
+{
+	char dir[1024];
+	char *env = envGet("SMALLSH_SCRIPT_CACHE");
+	if (env && env[0] != '\0')
+		snprintf(dir, sizeof(dir), "%s", env);
+	else
+		snprintf(dir, sizeof(dir), "%s/.smallsh_cache", envGet("HOME") ? envGet("HOME") : ".");
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+		return -1;
+	snprintf(path, size, "%s/%016llx.ssc", dir,
+		memoHash(14695981039346656037ULL, script, strlen(script)));
+	return 0;
+}
+
+/*******************************************************************************
+ * Function: compileScript
+ * Description: parse every line of a script without expanding "$$" and write
+ * 		the command lines to a buffer in the compiled format. Blank lines and
+ * 		comments are dropped. The bodies of here-documents are read from the
+ * 		script. A line with a syntax error is reported and becomes a
+ * 		record without words, which fails when it is run.
+ * Arguments: f: the script, opened for reading
+ * 	      header: a pointer to the struct ScriptHeader to fill in
+ * 	      script: char*, the absolute path of the script
+ * 	      b: a pointer to an empty struct ByteBuffer
+ * Postcondition: b holds the header, the path and the records
+ * Return value: the number of lines with a syntax error
+ * ****************************************************************************/
+int compileScript(FILE *f, struct ScriptHeader *header, const char *script, struct ByteBuffer *b)
+{
+	char *line = NULL;
+	size_t bufferSize = 0;
+	ssize_t n;
+	int i, errors = 0;
+	appendBytes(b, header, sizeof(*header));
+	appendString(b, script);
+	deferExpansion = 1;
+	while ((n = getline(&line, &bufferSize, f)) != -1)
+	{
+		if (n > 0 && line[n-1] == '\n')
+			line[n-1] = '\0';
+		struct CommandLine *c = parseLine(line);
+		if (!isComment(c))
+			readHereDocs(c, f);
+		if (c->invalid && !isComment(c))
+		{
+			//a record without words stands for the line with a syntax error
+			appendUint32(b, 4 * sizeof(uint32_t));
+			appendUint32(b, 0);
+			appendUint32(b, 0);
+			appendUint32(b, 0);
+			header->numCommands++;
+			errors++;
+		}
+		else if (c->size > 0 && !isComment(c))
+		{
+			size_t start = b->size;
+			appendUint32(b, 0);
+			appendUint32(b, c->size);
+			appendUint32(b, c->numRedirs);
+			appendUint32(b, c->bg);
+			for (i=0; i < c->size; i++)
+				appendString(b, c->arr[i]);
+			for (i=0; i < c->numRedirs; i++)
+			{
+				appendUint32(b, c->redirs[i].type);
+				appendUint32(b, c->redirs[i].fd);
+				appendUint32(b, c->redirs[i].srcFD);
+				appendString(b, c->redirs[i].target);
+			}
+			uint32_t recordLen = b->size - start;
+			memcpy(b->data + start, &recordLen, sizeof(recordLen));
+			header->numCommands++;
+		}
+		freeCommandLine(c);
+		memFree(MEM_PARSER, c);
+	}
+	deferExpansion = 0;
+	free(line);
+	memcpy(b->data, header, sizeof(*header));
+	return errors;
+}
+
+/*******************************************************************************
+ * Function: checkScriptString
+ * Description: check that a string of a record, as written by appendString, lies
+ * 		inside the record and is null terminated
+ * Arguments: data: char*, the compiled script
+ * 	      off: size_t*, the offset of the string, moved past it
+ * 	      end: size_t, the offset of the end of the record
+ * 	      optional: int, 1 if the string may be SCRIPT_NO_TARGET
+ * Return value: 0 if it is valid, -1 otherwise
+ * ****************************************************************************/
+int checkScriptString(const char *data, size_t *off, size_t end, int optional)
+{
+	uint32_t len;
+	if (end - *off < 4)
+		return -1;
+	memcpy(&len, data + *off, sizeof(len));
+	*off += 4;
+	if (len == SCRIPT_NO_TARGET)
+		return optional ? 0 : -1;
+	len &= ~SCRIPT_HAS_PID;
+	if (end - *off < (size_t)(len + 4) / 4 * 4 || data[*off + len] != '\0')
+		return -1;
+	*off += (size_t)(len + 4) / 4 * 4;
+	return 0;
+}
+
+/*******************************************************************************
+ * Function: checkScript
+ * Description: check that the records of a cache file are well formed before
+ * 		any of them is run: there are numCommands of them, each one lies
+ * 		inside the file and is at least as big as its fixed fields, and its
+ * 		words and redirections fill it exactly. A file cut short or changed
+ * 		by hand fails here and is compiled again.
+ * Arguments: data: char*, the compiled script
+ * 	      size: size_t, the size of data
+ * 	      off: size_t, the offset of the first record
+ * 	      numCommands: uint64_t, the number of records in the header
+ * Return value: 0 if it is valid, -1 otherwise
+ * ****************************************************************************/
+int checkScript(const char *data, size_t size, size_t off, uint64_t numCommands)
+{
+	uint32_t fields[4], i;
+	uint64_t n;
+	for (n=0; n < numCommands; n++)
+	{
+		if (off > size || size - off < sizeof(fields))
+			return -1;
+		memcpy(fields, data + off, sizeof(fields));
+		if (fields[0] < sizeof(fields) || fields[0] > size - off || fields[1] == 0)
+			return -1;
+		size_t end = off + fields[0];
+		off += sizeof(fields);
+		for (i=0; i < fields[1]; i++)
+			if (checkScriptString(data, &off, end, 0) == -1)
+				return -1;
+		for (i=0; i < fields[2]; i++)
+		{
+			int32_t redir[3];
+			if (end - off < sizeof(redir))
+				return -1;
+			memcpy(redir, data + off, sizeof(redir));
+			off += sizeof(redir);
+			if (redir[0] < REDIR_IN || redir[0] > REDIR_DATA || redir[0] == REDIR_HEREDOC
+				|| redir[1] < 0 || checkScriptString(data, &off, end,
+				redir[0] == REDIR_DUP || redir[0] == REDIR_CLOSE) == -1)
+				return -1;
+		}
+		if (off != end)
+			return -1;
+	}
+	return off == size ? 0 : -1;
+}
+
+/*******************************************************************************
+ * Function: openScript
+ * Description: get the compiled form of a script. If the cache file matches the
+ * 		path, size and mtime of the script and its records pass
+ * 		checkScript, it is mmap'd. Otherwise, or if reparse is 1, the
+ * 		script is compiled and the cache file is replaced, unless
+ * 		the script has a syntax error.
+ * Arguments: fileName: char*, the script
+ * 	      reparse: int, 1 to ignore the cache file
+ * 	      s: a pointer to the struct Script to fill in
+ * Return value: 0 on success, -1 if the script can't be read
+ * ****************************************************************************/
+int openScript(const char *fileName, int reparse, struct Script *s)
+{
+	char script[PATH_MAX], cache[1100];
+	struct ScriptHeader header;
+	struct stat st;
+	memset(s, 0, sizeof(*s));
+	FILE *f = fopen(fileName, "re");
+	if (f == NULL || fstat(fileno(f), &st) == -1 || realpath(fileName, script) == NULL)
+	{
+		perror(fileName);
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCRIPT_MAGIC, 4);
+	header.pathLen = strlen(script);
+	header.dev = st.st_dev;
+	header.ino = st.st_ino;
+	header.size = st.st_size;
+	header.mtimeSec = st.st_mtim.tv_sec;
+	header.mtimeNsec = st.st_mtim.tv_nsec;
+	int haveCache = scriptCachePath(script, cache, sizeof(cache)) == 0;
+
+	if (haveCache && !reparse)
+	{
+		int fd = open(cache, O_RDONLY | O_CLOEXEC);
+		struct stat cst;
+		if (fd != -1 && fstat(fd, &cst) == 0 && cst.st_size >= (off_t)(sizeof(header) + 4 + header.pathLen))
 		{
-			printf("Process %d terminated by SIGTERM\n", temp->pidNo);
-			fflush(stdout);
-			int deleted = deleteChildrenPids(children, temp->pidNo);
-			if (deleted == 0)
-			{
-				printf("Sucessfully deleted info for this process\n");
-				fflush(stdout);
-			}
-			else
+			char *map = (char*)mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			struct ScriptHeader *cached = (struct ScriptHeader*)map;
+			uint32_t pathLen;
+			if (map != MAP_FAILED)
 			{
-				printf("Error deleting info for this process\n");
-				fflush(stdout);
+				memcpy(&pathLen, map + sizeof(header), sizeof(pathLen));
+				header.numCommands = cached->numCommands;
+				size_t first = sizeof(header) + 4 + (size_t)(pathLen + 4) / 4 * 4;
+				if (memcmp(cached, &header, sizeof(header)) == 0 && pathLen == header.pathLen
+					&& memcmp(map + sizeof(header) + 4, script, pathLen) == 0
+					&& checkScript(map, cst.st_size, first, header.numCommands) == 0)
+				{
+					s->data = map;
+					s->size = cst.st_size;
+					s->off = first;
+					s->mapped = 1;
+					close(fd);
+					fclose(f);
+					return 0;
+				}
+				munmap(map, cst.st_size);
 			}
-
 		}
-		else
+		if (fd != -1)
+			close(fd);
+	}
+
+	struct ByteBuffer b = {NULL, 0, 0};
+	header.numCommands = 0;
+	//a script with syntax errors is not cached, so they are reported every run
+	int errors = compileScript(f, &header, script, &b);
+	fclose(f);
+	if (haveCache && errors == 0)
+	{
+		//write a new file and rename it, so a concurrent run never sees half of it
+		char tmp[1200];
+		snprintf(tmp, sizeof(tmp), "%s.%d", cache, getpid());
+		int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd != -1)
 		{
-			perror("Exit Failure: ");
+			size_t off = 0;
+			ssize_t n;
+			while (off < b.size && (n = write(fd, b.data + off, b.size - off)) > 0)
+				off += n;
+			close(fd);
+			if (off < b.size || rename(tmp, cache) == -1)
+				unlink(tmp);
 		}
-		i++;
 	}
+	s->data = b.data;
+	s->size = b.size;
+	s->off = sizeof(header) + 4 + (header.pathLen + 4) / 4 * 4;
+	s->mapped = 0;
+	return 0;
 }
 
-/*******************************************************************************************
- * Function: statusHandle
- * Description: This function prints to the terminal the exit status or the terminating signal
- * 		of the last foreground process ran by the shell.
- * Argument: exitMethod: int, the exit method of the last foreground process
- * Precondition: N/A
- * Postcondition: The exit status or terminating signal is printed to the terminal.
- * ******************************************************************************************/
-void statusHandle(int exitMethod)
+/*******************************************************************************
+ * Function: readScriptString
+ * Description: read a string of a record and expand "$$" if it was marked
+ * Arguments: s: a pointer to the struct Script
+ * 	      off: size_t*, the offset of the string, moved past it
+ * 	      expanded: char**, set to an expanded copy allocated for MEM_EXPAND,
+ * 	      		or NULL if the string has no "$$"
+ * Return value: the string, or NULL if it has no target
+ * ****************************************************************************/
+const char* readScriptString(struct Script *s, size_t *off, char **expanded)
 {
-	if (WIFEXITED(exitMethod) != 0)   //child exited normally
+	uint32_t len;
+	memcpy(&len, s->data + *off, sizeof(len));
+	*off += 4;
+	*expanded = NULL;
+	if (len == SCRIPT_NO_TARGET)
+		return NULL;
+	const char *str = s->data + *off;
+	int hasPid = (len & SCRIPT_HAS_PID) != 0;
+	len &= ~SCRIPT_HAS_PID;
+	*off += (len + 4) / 4 * 4;
+	if (hasPid)
 	{
-		int exitStatus = WEXITSTATUS(exitMethod);
-		if (exitStatus != 0)
-			exitStatus = 1;
-		printf("exit value %d\n",exitStatus);
-		fflush(stdout);
-	}		
-	else if (WIFSIGNALED(exitMethod) != 0) //child terminated by a signal
-	{	
-		printf("terminated by signal %d\n", WTERMSIG(exitMethod));
-		fflush(stdout);
+		*expanded = expandAllShellPid((char*)str);
+		return *expanded;
 	}
+	return str;
 }
 
-
-/*********************************************************************************
- * Function: execHandle
- * Dexcription: This function performs redirection of stdin and stdout if needed,
- * 		then calls execvp with the information in the struct CommandLine
- * Argument: c: a pointer to a struct Commandline that stores the information for
- * 		redirection and execvp
- * Precondition: N/A
- * Postcondition: The execvp runs successfully. Or the error message is output to
- * 		  the terminal and exit with 1.
- * Return value: N/A
- * ******************************************************************************/
-void execHandle(struct CommandLine *c)
+/*******************************************************************************
+ * Function: nextScriptCommand
+ * Description: build the next command line of a compiled script. A record
+ * 		without words gives a command line marked invalid.
+ * Argument: s: a pointer to the struct Script
+ * Return value: a pointer to a dynamically allocated struct CommandLine, or
+ * 		 NULL at the end of the script
+ * ****************************************************************************/
+struct CommandLine* nextScriptCommand(struct Script *s)
 {
-	//redirecting stdin and stdout
-	int sourceFD = 0, targetFD = 1, result;
-	if (c->inputFile)
+	uint32_t fields[4];
+	uint32_t i;
+	char *expanded;
+	if (s->off + sizeof(fields) > s->size)
+		return NULL;
+	memcpy(fields, s->data + s->off, sizeof(fields));
+	size_t off = s->off + sizeof(fields);
+	s->off += fields[0];
+
+	struct CommandLine *c = (struct CommandLine*)memAlloc(MEM_PARSER, sizeof(struct CommandLine));
+	assert(c);
+	initCommandLine(c, fields[1] + 2);
+	c->bg = fields[3];
+	c->invalid = fields[1] == 0;
+	for (i=0; i < fields[1]; i++)
 	{
-		sourceFD = open(c->inputFile, O_RDONLY);
-		if (sourceFD == -1)
-		{
-//			perror("source open()");
-			exit(errno);
-		}
-		result = dup2(sourceFD, 0);
-		if (result == -1)
-		{
-//			perror("source dup2()"); 
-			exit(errno);
-		}
+		addCommandLine(c, (char*)readScriptString(s, &off, &expanded));
+		memFree(MEM_EXPAND, expanded);
+	}
+	for (i=0; i < fields[2]; i++)
+	{
+		int32_t redir[3];
+		memcpy(redir, s->data + off, sizeof(redir));
+		off += sizeof(redir);
+		addRedirect(c, redir[0], redir[1], redir[2], readScriptString(s, &off, &expanded));
+		memFree(MEM_EXPAND, expanded);
 	}
+	return c;
+}
 
-	if (c->outputFile)
+/*******************************************************************************
+ * Function: closeScript
+ * Description: unmap or free the compiled script
+ * ****************************************************************************/
+void closeScript(struct Script *s)
+{
+	if (s->mapped)
+		munmap(s->data, s->size);
+	else
+		free(s->data);
+	s->data = NULL;
+}
+
+/*******************************************************************************
+ * Function: timeoutHandle
+ * Description: handle a command line starting with timeout.
+ * 		"timeout DURATION cmd args" gives cmd a deadline. The timeout words
+ * 		are removed so that cmd is dispatched like any other command. The
+ * 		built-in functions that run commands (memo, tee, tasks) pass the
+ * 		deadline on; the others finish at once and ignore it.
+ * 		"timeout -b DURATION" sets the default deadline of the background
+ * 		processes (0 turns it off), and "timeout -b" prints it.
+ * Arguments: c: a pointer to a struct CommandLine for the timeout command
+ * 	      deadline: long*, the deadline of cmd in ms is stored here
+ * Precondition: c->arr[0] is "timeout"
+ * Return value: 0 if c now holds a command to run, 1 if there is nothing to run
+ * ****************************************************************************/
+int timeoutHandle(struct CommandLine *c, long *deadline)
+{
+	if (c->size >= 2 && strcmp(c->arr[1], "-b") == 0)
 	{
-		targetFD = open(c->outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-		if (targetFD == -1)
-		{
-//			perror("target open()");
-			exit(errno);
-		}
-		result = dup2(targetFD, 1);
-		if (result == -1)
+		if (c->size == 2)
 		{
-//			perror("target dup2()");
-			exit(errno);
+			printf("background deadline %ldms\n", bgDeadline);
+			fflush(stdout);
 		}
+		else if (parseDuration(c->arr[2]) >= 0)
+			bgDeadline = parseDuration(c->arr[2]);
+		else
+			fprintf(stderr, "timeout: invalid duration %s\n", c->arr[2]);
+		return 1;
 	}
-	
-	// redirecting stdin and stdout
-	if (execvp(c->arr[0], c->arr) < 0)
+	if (c->size < 3 || parseDuration(c->arr[1]) < 0)
 	{
-//		perror("No such command");
-//		printf("errno is %d: %s\n",  errno, strerror(errno));
-//		fflush(stdout);
-		exit(errno);
+		fprintf(stderr, "usage: timeout DURATION command [args] | timeout -b [DURATION]\n");
+		return 1;
 	}
+	*deadline = parseDuration(c->arr[1]);
+	shiftCommandLine(c, 2);
+	return 0;
 }
 
 
-void parentCatchSIGTSTP(int signo)
+/*******************************************************************************
+ * Function: runLine
+ * Description: run one command line the way the shell loop does: set its
+ * 		NAME=value words, run a built-in function or start the command in
+ * 		the foreground or background, report the background processes
+ * 		that have finished, and put the variables back. The loop in main
+ * 		and the soak test of memstats both go through here.
+ * Arguments: sh: a pointer to the struct Shell
+ * 	      commands: a pointer to the struct CommandLine of the line, with its
+ * 	      		here-documents read
+ * 	      line: char*, the line, allocated for MEM_INPUT, or NULL
+ * Postcondition: line is freed, and commands is freed or kept by the job table
+ * ****************************************************************************/
+void runLine(struct Shell *sh, struct CommandLine *commands, char *line)
 {
-//	char* message = "Parent Caught SIGTSTP\n";
-//	write(STDOUT_FILENO, message, 22);
-	if (BGAllowed == 1)
+	const int MAXCHILDREN = 50; // the maximum number of children that can be spawned
+
+	//a line with a syntax error runs nothing, not even its assignments
+	if (commands->invalid && !isComment(commands))
 	{
-		write(STDOUT_FILENO, "Enter foreground only mode (& is ignored)\n: ",45);
-		BGAllowed = 0;
+		sh->lastFGExitMethod = 1 << 8;
+		sh->lastFGTimedOut = 0;
+		memFree(MEM_INPUT, line);
+		freeCommandLine(commands);
+		memFree(MEM_PARSER, commands);
+		return;
 	}
-	else
+	//NAME=value words set the variables; in front of a command, only for it
+	struct EnvUndo undo;
+	applyAssignments(commands, &undo);
+	//for debugging
+	if (commands->size == 0 ||  commands->arr[0][0] == '#')
 	{
-		write(STDOUT_FILENO, "Exit foreground only mode\n: ", 28);
-		BGAllowed = 1;
+		restoreAssignments(&undo);
+		memFree(MEM_INPUT, line);
+		freeCommandLine(commands);
+		memFree(MEM_PARSER, commands);
+		return;
 	}
+	pid_t spawnPid = -5;
+	int childExitMethod = -5;
+	long deadline = -1; // the deadline of the command in ms, -1 if none
+	int procType = 0; // 0 is non built-in; 1 is cd; 2 is status; 3 is exit; 4 is memo; 5 is tasks; 6 is timeout; 7 is jobs; 8 is memstats; 9 is export; 10 is unset; 11 is tee
 
-}
+	//assign the procType
+	//without -b, timeout only sets the deadline, and the rest of the line is
+	//dispatched below like any other command
+	if (strcmp(commands->arr[0], "timeout") == 0 && timeoutHandle(commands, &deadline))
+		procType = 6;
+	else if (strcmp(commands->arr[0], "cd")==0)
+	{
+		procType = 1;
+		cdHandle(commands);
+	}
+	else if (strcmp(commands->arr[0], "status") == 0)
+	{
+		procType = 2;
+		statusHandle(sh->lastFGExitMethod, sh->lastFGTimedOut);
+	}
+	else if (strcmp(commands->arr[0], "exit") == 0)
+	{
+		procType = 3;
+		sh->keepGoing = 0;
+		exitHandle(&sh->children);
+	}
+	else if (strcmp(commands->arr[0], "memo") == 0)
+	{
+		procType = 4;
+		sh->lastFGTimedOut = 0;
+		memoHandle(commands, &sh->children, deadline, &sh->lastFGExitMethod, &sh->lastFGTimedOut);
+	}
+	else if (strcmp(commands->arr[0], "tasks") == 0)
+	{
+		procType = 5;
+		tasksHandle(commands, &sh->children, MAXCHILDREN, deadline, &sh->lastFGExitMethod);
+		sh->lastFGTimedOut = 0;
+	}
+	else if (strcmp(commands->arr[0], "jobs") == 0)
+	{
+		procType = 7;
+		jobsHandle(commands, &sh->children);
+	}
+	else if (strcmp(commands->arr[0], "memstats") == 0)
+	{
+		procType = 8;
+		memstatsHandle(commands, sh);
+		sh->lastFGTimedOut = 0;
+	}
+	else if (strcmp(commands->arr[0], "export") == 0)
+	{
+		procType = 9;
+		exportHandle(commands);
+	}
+	else if (strcmp(commands->arr[0], "unset") == 0)
+	{
+		procType = 10;
+		unsetHandle(commands);
+	}
+	else if (strcmp(commands->arr[0], "tee") == 0)
+	{
+		procType = 11;
+		sh->lastFGTimedOut = 0;
+		teeHandle(commands, &sh->children, deadline, &sh->lastFGExitMethod, &sh->lastFGTimedOut);
+	}
+	if (procType >= 1 && procType <= 11)
+	{
+		restoreAssignments(&undo);
+		memFree(MEM_INPUT, line);
+		freeCommandLine(commands);
+		memFree(MEM_PARSER, commands);
+		return;
+	}
 
-/********************************************************************************************************
- * Function: decipherExitStatus
- * Description: determine the exit status of the passed in childExitMethod, and then store
- * 		appropriate values in the pointed int values;
- * Arguments: childExitMethod: int, the code returned by the terminated child process
- * 	      exited: int*, the int pointed to will be 1 if the child exited normally. 0 otherwise
- * 	      exitStatus: int*, the int pointed to will be the exit status if childe exited normally.
- * 	      signaled: int*, the int pointed to will be 1 if the child exited upon a signal. 0 otherwise.
- * 	      termSignal: in*, the int pointed to will be the signal that killed the child process.
- * Precondition: all the input are valid.
- * Postcondition: the deciphered information are stored in the addresses that the pointers point to.
- * ******************************************************************************************************/
-void decipherExitStatus(int childExitMethod, int* exited, int* exitStatus, int* signaled, int* termSignal)
-{
+	/*decide whether the background processing is allowed
+	the built-in functions, status, exit, and cd, run in foreground only
+	the other functions will can run in background if the global variable BGAllowed
+	is 1. If BGAllowed is 0, then run all the processes in foreground.*/
+	if (procType != 0)
+	{
+		commands->bg = 0;
+	}
+	else if (BGAllowed == 0)
+	{
+		commands->bg = 0;
+	}
 
-	if (WIFEXITED(childExitMethod) != 0)   //child terminated normally
+	if (deadline < 0 && commands->bg == 1 && bgDeadline > 0)
+		deadline = bgDeadline;
+	//the job table frees commands after the child process finishes
+	spawnPid = spawnCommand(commands, &sh->children, -1, deadline, 1)->pidNo;
+	// if too many children are running at the same time, then abort
+	if (sh->children.size == MAXCHILDREN) 				
+		abort();
+	// let the user know that a background process has started
+	if (commands->bg == 1)
 	{
-		*exited = 1;
-		*exitStatus = WEXITSTATUS(childExitMethod);
-		*signaled = 0;
-		*termSignal = 0;
+		printf("Background process %d starts\n", spawnPid);
+		fflush(stdout);
 	}		
-	else if (WIFSIGNALED(childExitMethod) != 0) //child terminated by a signal
-	{	
-		*signaled = 1;
-		*termSignal = WTERMSIG(childExitMethod);
-		*exited = 0;
-		*exitStatus = 0;
-	}					
+	else // a foreground process
+	{
+		sh->lastFGTimedOut = waitForeground(&sh->children, spawnPid, &childExitMethod);
+		sh->lastFGExitMethod = childExitMethod;
+		reportFGExit(spawnPid, childExitMethod, sh->lastFGTimedOut);
+	}
+	//check if any of the background child process has finished
+	if (sh->children.size != 0)
+		checkBGChildren(&sh->children);		
+
+	restoreAssignments(&undo);
+	memFree(MEM_INPUT, line);
 }
 
-/**********************************************************************************************
- * Function: checkBGChildren
- * Description: This function checks whether the background child processes have finished. If
- * 		yes, then it cleans them up.
- * Argument: children, a pointer to a struct ChildrenPids, which stores the child processes
- * Precondition: children has at least 1 element
- * Postcondition: If the child process in children has finished, then it is cleaned up and removed
- * 		  from children
- * Return value: N/A
- * **********************************************************************************************/
-void checkBGChildren(struct ChildrenPids *children)
-{		
-	//use an array to store the pid of the background processes
-	assert(children->size);
-	pid_t *bgChildren=(pid_t*)calloc(children->size, sizeof(pid_t));
-	int i=0;
-	struct Link* temp = children->list;
-	while (temp)   //copy the pids in the linked list to the array
+int main(int argc, char *argv[])
+{
+	struct Shell sh;
+	initChildrenPids(&sh.children);
+	sh.lastFGExitMethod = 0;
+	sh.lastFGTimedOut = 0;
+	sh.keepGoing = 1; //variable to tell the parent to keep taking commands
+	envInit();
+
+	// "smallsh [-r] script" runs a script from its compiled form; -r compiles it again
+	struct Script script;
+	int runScript = 0, reparse = 0, arg = 1;
+	if (arg < argc && strcmp(argv[arg], "-r") == 0)
 	{
-		bgChildren[i] = temp->pidNo;
-		temp = temp->next;
-		i++;
+		reparse = 1;
+		arg++;
 	}
-	
-	//Check each pid. If it's finished, clean up.
-	int childExitMethod,exited, exitStatus, signaled, termSignal;
-	pid_t currPid;
-	for (i=0; i < children->size; i++)
+	if (arg < argc)
 	{
-		if ((currPid = waitpid(bgChildren[i], &childExitMethod, WNOHANG)) != 0)
-		{	
-			deleteChildrenPids(children, currPid);
-			
-			printf("Background process %d has finished: ", currPid);
-			fflush(stdout);
-			//Decipher the type of termination
-			decipherExitStatus(childExitMethod, &exited, &exitStatus, &signaled, &termSignal);
-			if (exited)
-			{
-				if (exitStatus == 0)
-				{
-					printf("exit value 0\n");
-					fflush(stdout);
-				}
-				if (exitStatus != 0)
-				{
-					printf("exited value %d\n", exitStatus); 
-					fflush(stdout);
-				}
-			}
-			else if (signaled)
-			{
-				printf("terminated by signal %d\n",  termSignal);
-				fflush(stdout);
-			}
-			
-		}
+		if (openScript(argv[arg], reparse, &script) == -1)
+			return 1;
+		runScript = 1;
 	}
-	free(bgChildren);	
-}
-
-int main()
-{
-	const int MAXCHILDREN = 50; // the maximum number of children that can be spawned
-	struct ChildrenPids children;
-	initChildrenPids(&children);
-	int lastFGExitMethod = 0;
 
 	// Set up the signals
-	struct sigaction pSIGTSTP_action = {{0}}, ignore_action = {{0}}, default_action = {{0}};
+	struct sigaction pSIGTSTP_action = {{0}}, ignore_action = {{0}};
 
 	ignore_action.sa_handler = SIG_IGN;
 	ignore_action.sa_flags = SA_RESTART;
 
 	sigaction(SIGINT, &ignore_action, NULL);  //setting parent SIGINT 
 	
-	default_action.sa_handler = SIG_DFL;
-	sigfillset(&default_action.sa_mask);
-	default_action.sa_flags = SA_RESTART;
 	
 	pSIGTSTP_action.sa_handler = parentCatchSIGTSTP;
 	sigfillset(&pSIGTSTP_action.sa_mask);
@@ -761,156 +5075,43 @@ int main()
 	sigaction(SIGTSTP, &pSIGTSTP_action, NULL);//setting parent SIGTSTP
 
 
-	int exited, exitStatus, signaled, termSignal;
-	int keepGoing = 1; //variable to tell the parent to keep taking commands
 	// keep getting command line from user
-	while (keepGoing)
+	while (sh.keepGoing)
 	{
-		printf(": ");
-		fflush(stdout);	
 		char *line = NULL;
-		int sizeLine = readLine(&line);
-		//remove the ending newline character
-		line[sizeLine - 1]='\0';
-		//commands will be freed after child process finishes
-		struct CommandLine *commands = parseLine(line);
-		//for debugging
-		if (commands->size == 0 ||  commands->arr[0][0] == '#')
-		{
-			free(line);
-			line = NULL;
-			freeCommandLine(commands);
-			free(commands);
-			continue;
-		}
-		pid_t spawnPid = -5;
-		int childExitMethod = -5;
-		int procType = 0; // 0 is non built-in; 1 is cd; 2 is status; 3 is exit
-		//assign the procType
-		if (strcmp(commands->arr[0], "cd")==0)
-		{
-			procType = 1;
-			cdHandle(commands);
-		}
-		else if (strcmp(commands->arr[0], "status") == 0)
-		{
-			procType = 2;
-			statusHandle(lastFGExitMethod);
-		}
-		else if (strcmp(commands->arr[0], "exit") == 0)
-		{
-			procType = 3;
-			keepGoing = 0;
-			exitHandle(&children);
-		}
-		if (procType == 1 || procType == 2 || procType == 3)
+		//commands will be freed by runLine or after the child process finishes
+		struct CommandLine *commands;
+		if (runScript)
 		{
-			free(line);
-			line = NULL;
-			freeCommandLine(commands);
-			free(commands);
-			continue;
-		}
-	
-		/*decide whether the background processing is allowed
-		the built-in functions, status, exit, and cd, run in foreground only
-		the other functions will can run in background if the global variable BGAllowed
-		is 1. If BGAllowed is 0, then run all the processes in foreground.*/
-		if (procType != 0)
-		{
-			commands->bg = 0;
-		}
-		else if (BGAllowed == 0)
-		{
-			commands->bg = 0;
-		}
-
-		spawnPid = fork();		
-		
-
-		if (spawnPid == -1)  //fork error
-		{	
-			perror("Hull Breach!");
-			exit(1);
-		}
-		else if (spawnPid == 0) //child process
-		{
-			
-			if (commands->bg == 0)  //a foreground process
-			{		
-				//Will be terminated by SIGINT signal
-				sigaction(SIGINT, &default_action, NULL);
+			commands = nextScriptCommand(&script);
+			if (commands == NULL)  //end of the script is the same as exit
+			{
+				exitHandle(&sh.children);
+				break;
 			}
-			
-			//All processe will ignore SIGTSTP signal
-			sigaction(SIGTSTP, &ignore_action, NULL);
-		
-			execHandle(commands);	
 		}
-		else  //parent process  
-		{	
-			addChildrenPids(&children,spawnPid,commands, commands->bg);		
-			// if too many children are running at the same time, then abort
-			if (children.size == MAXCHILDREN) 				
-				abort();
-			// let the user know that a background process has started
-			if (commands->bg == 1)
-			{
-				printf("Background process %d starts\n", spawnPid);
-				fflush(stdout);
-			}		
-		
-			if (commands->bg == 0) // a foreground process
-			{
-				//block the SIGTSTP signal while waiting for the child process
-				sigset_t toBlock;
-				if (sigemptyset(&toBlock) == -1)
-					perror("Failed to set sigset_t toBlock");
-				if (sigaddset(&toBlock, SIGTSTP) == -1)
-					perror("Failed to add SIGTSTP to sigset_t toBlock");
-				if (sigprocmask(SIG_BLOCK, &toBlock, NULL) != 0)
-					perror("SIGTSTP is not blocked in foreground child process");
-				
-				//Wait for the child to finish
-				waitpid(spawnPid,&childExitMethod, 0);
-
-				//unblock the SIGTSTP signal
-				if (sigprocmask(SIG_UNBLOCK, &toBlock, NULL) != 0)
-					perror("SIGTSTP is not unblocked");
-	
-				//clear up the command and pid saved for the child process
-				deleteChildrenPids(&children, spawnPid);
-			
-				//Decipher the type of termination
-//				printf("childExitMethod is %d\n", childExitMethod);
-//				fflush(stdout);
-				decipherExitStatus(childExitMethod, &exited, &exitStatus, &signaled, &termSignal);
-				lastFGExitMethod = childExitMethod;
-				if (exited)
-				{
-		//			lastFGExitMethod = 0;
-					if (exitStatus != 0)
-					{
-		//				lastFGExitMethod = 1; 
-						printf("Error: %s\n", strerror(exitStatus));
-						fflush(stdout);
-					}
-				}
-				else if (signaled)
-				{
-		//			lastFGExitMethod = childExitMethod;
-					printf("Foreground process %d is terminated by signal %d\n", spawnPid, termSignal);
-					fflush(stdout);
-				}
+		else
+		{
+			printf(": ");
+			fflush(stdout);	
+			int sizeLine = readLine(&line, &sh.children);
+			if (sizeLine == -1)  //end of the input is the same as exit
+			{
+				exitHandle(&sh.children);
+				break;
 			}
+			//remove the ending newline character
+			if (line[sizeLine - 1] == '\n')
+				line[sizeLine - 1]='\0';
+			commands = parseLine(line);
+			if (!isComment(commands))
+				readHereDocs(commands, stdin);
 		}
-		//check if any of the background child process has finished
-		if (children.size != 0)
-			checkBGChildren(&children);		
-
-		free(line);
-		line = NULL;
+		runLine(&sh, commands, line);
 	}
 
+	freeChildrenPids(&sh.children);
+	if (runScript)
+		closeScript(&script);
 	return 0;
 }